@@ -0,0 +1,107 @@
+#ifndef ARBITRAGE_H_
+#define ARBITRAGE_H_
+
+#include <cmath>
+#include <deque>
+#include "solver.h"
+#include "utils/types.h"
+#include "utils/string.h"
+
+// Conversion cycles whose product of exchange rates to_units/from_units exceeds 1.
+// With the edge weights log(from_units)-log(to_units) these are the negative
+// cycles, which are found by SPFA (queue-based Bellman-Ford) from a virtual
+// source connected to every resource. Every n relaxations the shortest path
+// tree (the parent edges) is checked for cycles, each of which is negative.
+// A found cycle is broken by removing its least profitable edge and the
+// relaxation continues: removing edges keeps the current distances valid, so
+// the whole search is a single SPFA run. Afterwards the remaining graph has no
+// arbitrage, so every profitable cycle goes through the removed edge of some
+// reported cycle.
+struct Arbitrage {
+  struct Cycle {
+    Path edges;
+    double rate; // product of the exchange rates along the cycle
+    bool one_shot; // goes through a WTB offer, so it can be run once only
+  };
+
+  static vec<Cycle> find(const Spec &S) {
+    auto &C = S.csr;
+    size_t n = C.nodes();
+    vec<double> w(C.edges());
+    for(EdgeID e=0; e<C.edges(); e++) w[e] = std::log(double(C.from_units[e]))-std::log(double(C.to_units[e]));
+    vec<bool> removed(C.edges(),false);
+    vec<Cycle> cycles;
+
+    vec<double> d(n,0);
+    vec<EdgeID> parent(n,NONE);
+    vec<bool> queued(n,true);
+    std::deque<ResourceID> Q;
+    for(ResourceID r=0; r<n; r++) Q.push_back(r);
+    // Breaks all the cycles of the parent graph.
+    vec<size_t> seen(n,0);
+    size_t walk = 0;
+    auto break_cycles = [&]{
+      for(ResourceID r=0; r<n; r++) {
+        if(seen[r]) continue;
+        walk++;
+        auto x = r;
+        for(; x!=NONE && !seen[x]; x = parent[x]==NONE ? NONE : C.from_res[parent[x]]) seen[x] = walk;
+        if(x==NONE || seen[x]!=walk) continue;
+        // x is on a new cycle.
+        Cycle c{{},0,false};
+        EdgeID weakest = parent[x];
+        double sum = 0;
+        auto y = x;
+        do {
+          auto e = parent[y];
+          c.edges.push_back(e);
+          sum += w[e];
+          if(w[e]>w[weakest]) weakest = e;
+          c.one_shot |= C.to_res[e]==S.gold_id;
+          y = C.from_res[e];
+        } while(y!=x);
+        std::reverse(c.edges.begin(),c.edges.end());
+        c.rate = std::exp(-sum);
+        cycles.push_back(c);
+        removed[weakest] = true;
+        parent[C.to_res[weakest]] = NONE;
+      }
+      std::fill(seen.begin(),seen.end(),0);
+    };
+
+    size_t relaxed = 0;
+    while(Q.size()) {
+      auto u = Q.front(); Q.pop_front();
+      queued[u] = false;
+      for(EdgeID e=C.begin[u]; e<C.begin[u+1]; e++) {
+        if(removed[e]) continue;
+        auto v = C.to_res[e];
+        double dv = d[u]+w[e];
+        if(dv>=d[v]-eps*(1+std::abs(d[v]))) continue;
+        d[v] = dv;
+        parent[v] = e;
+        if(!queued[v]){ queued[v] = true; Q.push_back(v); }
+        if(++relaxed%n==0) break_cycles();
+      }
+    }
+    // Without negative cycles the relaxation stops, but some may have closed
+    // since the last check.
+    break_cycles();
+    return cycles;
+  }
+
+  static str show(const Spec &S, const Cycle &c) {
+    vec<str> steps;
+    for(auto e : c.edges) steps.push_back(util::fmt("%x % -%> %x %",
+      S.csr.from_units[e],S.names.lookup_name(S.csr.from_res[e]),S.csr.offer[e],
+      S.csr.to_units[e],S.names.lookup_name(S.csr.to_res[e])));
+    return util::fmt("rate = %%: %",c.rate,c.one_shot ? " (one shot)" : "",util::join(", ",steps));
+  }
+
+private:
+  static constexpr EdgeID NONE = EdgeID(-1);
+  // Relative slack, so that cycles of rate 1 are not reported due to rounding.
+  static constexpr double eps = 1e-12;
+};
+
+#endif  // ARBITRAGE_H_
@@ -0,0 +1,304 @@
+#ifndef BOOK_H_
+#define BOOK_H_
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string_view>
+#include "spec.h"
+#include "utils/types.h"
+#include "utils/log.h"
+#include "utils/string.h"
+#include "utils/read_file.h"
+
+namespace spec {
+
+// Offer book: the market offers and the starting inventory.
+// Any size can be loaded, but the search keeps the WTB offers in a util::Bitset
+// and the resources in a util::FixedVec, so it supports at most util::max_bits
+// of the former and util::max_capacity of the latter.
+struct Book {
+  vec<Obj> inventory;
+  vec<Offer> wts, wtb;
+  vec<size_t> filled; // indices of the wtb offers filled already
+};
+
+static Book builtin_book() { return {Inventory(),WTS(),WTB(),Filled()}; }
+
+// Name of the gold resource. The WTB offers, and only they, buy gold.
+constexpr std::string_view gold = "g";
+
+// Parses a decimal number, failing with an error at where on a malformed or
+// out of range one.
+static uint64_t parse_number(std::string_view s, const str &where) {
+  if(s.empty() || s.find_first_not_of("0123456789")!=s.npos) error("%: expected a number, got '%'",where,s);
+  try { return std::stoull(str(s)); }
+  catch(const std::out_of_range&) { error("%: number % out of range",where,s); }
+}
+
+// Text form of a Book, one entry per line:
+//   inv <count> <name>
+//   wts <count> <name> = <count> <name>
+//   wtb <count> <name> = <count> <name>
+//   filled <index of a wtb entry>
+// where an offer line reads "<obj> = <price>".
+// Empty lines and lines starting with '#' are ignored.
+// The counts of an offer are positive, and the WTB offers are exactly those
+// with obj gold.
+static Book parse_book(const str &text) {
+  Book b;
+  auto lines = util::split(text,"\n");
+  for(size_t l=0; l<lines.size(); l++) {
+    auto line = std::string_view(lines[l]);
+    auto trim = [](std::string_view s) {
+      while(s.size() && isspace(s.front())) s.remove_prefix(1);
+      while(s.size() && isspace(s.back())) s.remove_suffix(1);
+      return s;
+    };
+    auto parse_obj = [&](std::string_view s) {
+      s = trim(s);
+      size_t n = 0;
+      while(n<s.size() && isdigit(s[n])) n++;
+      auto name = trim(s.substr(n));
+      if(!n || n==s.size() || !isspace(s[n]) || name.empty()) error("book:%: expected '<count> <name>', got '%'",l+1,s);
+      return Obj{str(name),parse_number(s.substr(0,n),util::fmt("book:%",l+1))};
+    };
+    line = trim(line);
+    if(line.empty() || line[0]=='#') continue;
+    auto kind = line.substr(0,std::min(line.find_first_of(" \t"),line.size()));
+    auto rest = line.substr(kind.size());
+    if(rest.empty()) error("book:%: unknown entry '%'",l+1,line);
+    if(kind=="inv") { b.inventory.push_back(parse_obj(rest)); continue; }
+    if(kind=="filled") {
+      b.filled.push_back(parse_number(trim(rest),util::fmt("book:%",l+1)));
+      continue;
+    }
+    if(kind!="wts" && kind!="wtb") error("book:%: unknown entry '%'",l+1,line);
+    auto eq = rest.find('=');
+    if(eq==rest.npos) error("book:%: expected '<obj> = <price>', got '%'",l+1,rest);
+    Offer o{parse_obj(rest.substr(0,eq)),parse_obj(rest.substr(eq+1))};
+    if(!o.obj.count || !o.price.count) error("book:%: empty offer '%'",l+1,line);
+    if((kind=="wtb")!=(o.obj.name==gold)) error("book:%: % offer '%' has to buy gold iff it is a WTB one",l+1,kind,line);
+    (kind=="wts" ? b.wts : b.wtb).push_back(o);
+  }
+  return b;
+}
+
+static str show_book(const Book &b) {
+  auto show_obj = [](const Obj &o){ return util::fmt("% %",o.count,o.name); };
+  str s;
+  for(auto &x : b.inventory) s += "inv " + show_obj(x) + "\n";
+  for(auto &o : b.wts) s += util::fmt("wts % = %\n",show_obj(o.obj),show_obj(o.price));
+  for(auto &o : b.wtb) s += util::fmt("wtb % = %\n",show_obj(o.obj),show_obj(o.price));
+  for(auto i : b.filled) s += util::fmt("filled %\n",i);
+  return s;
+}
+
+// Text form of a sequence of starting inventories: groups of
+//   inv <count> <name>
+// lines, separated by empty lines.
+static vec<vec<Obj>> parse_inventories(const str &text) {
+  vec<vec<Obj>> invs;
+  str group;
+  auto flush = [&] {
+    auto b = parse_book(group);
+    if(b.wts.size() || b.wtb.size() || b.filled.size()) error("inventories: expected 'inv' lines only, got '%'",group);
+    if(b.inventory.size()) invs.push_back(b.inventory);
+    group.clear();
+  };
+  for(auto &line : util::split(text,"\n")) {
+    if(line.find_first_not_of(" \t\r")==str::npos) flush();
+    else group += line + "\n";
+  }
+  flush();
+  return invs;
+}
+
+// Change of a Book by a single offer.
+struct BookChange {
+  bool del; // removal of the offer id, otherwise addition of offer
+  size_t id;
+  bool wtb;
+  Offer offer;
+};
+
+// Text form of a sequence of changes, one per line:
+//   wts <count> <name> = <count> <name>   -- adds an offer
+//   wtb <count> <name> = <count> <name>
+//   del <offer index>                     -- removes an offer
+// Offers are indexed WTB first, by the book after the preceding changes.
+static vec<BookChange> parse_changes(const str &text) {
+  vec<BookChange> changes;
+  auto lines = util::split(text,"\n");
+  for(size_t l=0; l<lines.size(); l++) {
+    auto &line = lines[l];
+    size_t b = line.find_first_not_of(" \t");
+    if(b==line.npos || line[b]=='#') continue;
+    if(line.compare(b,4,"del ")==0) {
+      auto i = line.substr(b+4);
+      i.erase(0,i.find_first_not_of(" \t"));
+      i.erase(i.find_last_not_of(" \t\r")+1);
+      changes.push_back({.del = true, .id = parse_number(i,util::fmt("changes:%",l+1)), .wtb = false, .offer = {}});
+      continue;
+    }
+    auto x = parse_book(line);
+    if(x.wts.size()+x.wtb.size()!=1) error("changes:%: expected an offer or 'del <index>', got '%'",l+1,line);
+    bool wtb = x.wtb.size();
+    changes.push_back({.del = false, .id = 0, .wtb = wtb, .offer = wtb ? x.wtb[0] : x.wts[0]});
+  }
+  return changes;
+}
+
+// Binary form of a Book, used in place (memory-mapped).
+// Layout (native endianness):
+//   Header
+//   uint32_t name_end[names]  -- name i is blob[name_end[i-1],name_end[i])
+//   uint32_t filled[filled]   -- indices of the WTB offers filled already
+//   padding to 8 bytes
+//   Item inventory[inventory]
+//   OfferRec offers[wtb+wts] -- WTB offers first, so that offer IDs match Spec
+//   char blob[name_end[names-1]]
+// Names are stored once and referenced by index.
+struct BookView {
+  // Array of T, used in place.
+  template<typename T> struct Span {
+    const T *b = 0;
+    size_t n = 0;
+    const T* begin() const { return b; }
+    const T* end() const { return b+n; }
+    size_t size() const { return n; }
+    const T& operator[](size_t i) const { return b[i]; }
+  };
+  struct Header {
+    char magic[8];
+    uint32_t names, inventory, wtb, wts, filled, _pad;
+  };
+  struct Item { uint32_t name; uint32_t _pad; uint64_t count; };
+  struct OfferRec { Item obj, price; };
+  static constexpr char magic[8] = {'T','P','B','O','O','K','1','\n'};
+
+  static bool is_binary(const Byte *data, size_t size) {
+    return size>=sizeof magic && !memcmp(data,magic,sizeof magic);
+  }
+
+  static BookView encode(const Book &b) {
+    std::map<str,uint32_t> ids;
+    vec<uint32_t> name_end;
+    str blob;
+    auto item = [&](const Obj &o) {
+      auto [it,fresh] = ids.emplace(o.name,ids.size());
+      if(fresh){ blob += o.name; name_end.push_back(blob.size()); }
+      return Item{it->second,0,o.count};
+    };
+    // Interned in the order in which make_spec() used to assign the ResourceIDs.
+    vec<OfferRec> offers;
+    for(auto &o : b.wtb) { auto x = item(o.obj); offers.push_back({x,item(o.price)}); }
+    for(auto &o : b.wts) { auto x = item(o.obj); offers.push_back({x,item(o.price)}); }
+    vec<Item> inventory;
+    for(auto &x : b.inventory) inventory.push_back(item(x));
+
+    Header h;
+    memcpy(h.magic,magic,sizeof magic);
+    h.names = name_end.size();
+    h.inventory = inventory.size();
+    h.wtb = b.wtb.size();
+    h.wts = b.wts.size();
+    h.filled = b.filled.size();
+    h._pad = 0;
+    vec<uint32_t> filled;
+    for(auto i : b.filled) {
+      if(i>=b.wtb.size()) error("BookView: filled offer % out of range",i);
+      filled.push_back(i);
+    }
+    auto bytes = std::make_shared<Bytes>();
+    auto append = [&](const void *p, size_t n){ bytes->insert(bytes->end(),(const Byte*)p,(const Byte*)p+n); };
+    append(&h,sizeof h);
+    append(name_end.data(),name_end.size()*sizeof(uint32_t));
+    append(filled.data(),filled.size()*sizeof(uint32_t));
+    bytes->resize(align(bytes->size()));
+    append(inventory.data(),inventory.size()*sizeof(Item));
+    append(offers.data(),offers.size()*sizeof(OfferRec));
+    append(blob.data(),blob.size());
+    return BookView(bytes,bytes->data(),bytes->size());
+  }
+
+  // Loads a book in either form, detected by the magic prefix.
+  static BookView load(str path) {
+    auto f = std::make_shared<util::MappedFile>(path);
+    if(is_binary(f->data(),f->size())) return BookView(f,f->data(),f->size());
+    return encode(parse_book(str((const char*)f->data(),f->size())));
+  }
+
+  size_t names() const { return h->names; }
+  std::string_view name(size_t i) const {
+    size_t b = i ? name_end[i-1] : 0;
+    return std::string_view(blob+b,name_end[i]-b);
+  }
+  Span<Item> inventory() const { return {inv,h->inventory}; }
+  Span<OfferRec> offers() const { return {off,size_t(h->wtb)+h->wts}; }
+  Span<uint32_t> filled() const { return {fill,h->filled}; }
+  size_t wtb() const { return h->wtb; }
+  size_t wts() const { return h->wts; }
+  Span<Byte> bytes() const { return {data,size}; }
+
+  Book decode() const {
+    auto obj = [&](const Item &x){ return Obj{str(name(x.name)),x.count}; };
+    Book b;
+    for(auto &x : inventory()) b.inventory.push_back(obj(x));
+    auto O = offers();
+    for(size_t i=0; i<O.size(); i++) (i<wtb() ? b.wtb : b.wts).push_back({obj(O[i].obj),obj(O[i].price)});
+    b.filled.assign(filled().begin(),filled().end());
+    return b;
+  }
+
+private:
+  BookView(std::shared_ptr<const void> _owner, const Byte *_data, size_t _size) : owner(_owner), data(_data), size(_size) {
+    if(!is_binary(data,size)) error("BookView: bad magic");
+    if(size<sizeof(Header)) error("BookView: truncated header");
+    h = (const Header*)data;
+    size_t off_names = sizeof(Header);
+    size_t off_filled = off_names + size_t(h->names)*sizeof(uint32_t);
+    size_t off_inv = align(off_filled + size_t(h->filled)*sizeof(uint32_t));
+    size_t off_offers = off_inv + size_t(h->inventory)*sizeof(Item);
+    size_t off_blob = off_offers + (size_t(h->wtb)+h->wts)*sizeof(OfferRec);
+    if(off_blob>size) error("BookView: truncated, % < %",size,off_blob);
+    name_end = (const uint32_t*)(data+off_names);
+    fill = (const uint32_t*)(data+off_filled);
+    inv = (const Item*)(data+off_inv);
+    off = (const OfferRec*)(data+off_offers);
+    blob = (const char*)(data+off_blob);
+    size_t blob_size = size-off_blob;
+    for(size_t i=0; i<h->names; i++) {
+      if(name_end[i]>blob_size || (i && name_end[i]<name_end[i-1])) error("BookView: bad name %",i);
+    }
+    auto check = [&](const Item &x){ if(x.name>=h->names) error("BookView: bad name index %",x.name); };
+    for(auto &x : inventory()) check(x);
+    size_t gold_name = h->names;
+    for(size_t i=0; i<h->names; i++) if(name(i)==gold) gold_name = i;
+    auto O = offers();
+    for(size_t i=0; i<O.size(); i++) {
+      check(O[i].obj); check(O[i].price);
+      if(!O[i].obj.count || !O[i].price.count) error("BookView: empty offer %",i);
+      if((i<h->wtb)!=(O[i].obj.name==gold_name)) error("BookView: offer % has to buy gold iff it is a WTB one",i);
+    }
+    for(auto i : filled()) if(i>=h->wtb) error("BookView: bad filled offer %",i);
+  }
+
+  static size_t align(size_t n){ return (n+7)&~size_t(7); }
+
+  std::shared_ptr<const void> owner;
+  const Byte *data;
+  size_t size;
+  const Header *h;
+  const uint32_t *name_end;
+  const uint32_t *fill;
+  const Item *inv;
+  const OfferRec *off;
+  const char *blob;
+};
+
+} // namespace spec
+
+#endif  // BOOK_H_
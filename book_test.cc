@@ -0,0 +1,114 @@
+#include <unistd.h>
+#include "gtest/gtest.h"
+#include "book.h"
+#include "utils/types.h"
+#include "utils/read_file.h"
+
+// error() messages go to the logged stderr, checked by the death tests.
+static util::StreamLogger logger(std::cerr);
+
+static const char *text = R"(
+# comment
+inv 125 g
+inv 1 Stormwind Cheddar
+wts 1 Healing Potion = 2 g
+wts 1 Hand Axe = 2 g
+wtb 10 g = 6 Hand Axe
+wtb 18 g = 1 Healing Potion
+filled 1
+)";
+
+// A temporary file with the given contents, removed at the end of the scope.
+struct TempFile {
+  str path;
+  explicit TempFile(const Bytes &data) {
+    char p[] = "/tmp/book_test_XXXXXX";
+    int fd = mkstemp(p);
+    if(fd==-1) error("mkstemp()");
+    close(fd);
+    path = p;
+    util::write_file(path,data);
+  }
+  ~TempFile(){ unlink(path.c_str()); }
+};
+
+static Bytes bytes(const spec::BookView &B){ return Bytes(B.bytes().begin(),B.bytes().end()); }
+
+TEST(book,parse) {
+  auto b = spec::parse_book(text);
+  ASSERT_EQ(2,b.inventory.size());
+  EXPECT_EQ("Stormwind Cheddar",b.inventory[1].name);
+  ASSERT_EQ(2,b.wts.size());
+  ASSERT_EQ(2,b.wtb.size());
+  EXPECT_EQ("g",b.wtb[0].obj.name);
+  EXPECT_EQ(10,b.wtb[0].obj.count);
+  EXPECT_EQ("Hand Axe",b.wtb[0].price.name);
+  EXPECT_EQ(6,b.wtb[0].price.count);
+  EXPECT_EQ((vec<size_t>{1}),b.filled);
+  EXPECT_EQ(spec::show_book(b),spec::show_book(spec::parse_book(spec::show_book(b))));
+}
+
+TEST(book,round_trip) {
+  auto b = spec::parse_book(text);
+  auto B = spec::BookView::encode(b);
+  EXPECT_EQ(spec::show_book(b),spec::show_book(B.decode()));
+  // Loaded back from the binary form and from the text form.
+  TempFile bin(bytes(B));
+  auto L = spec::BookView::load(bin.path);
+  EXPECT_EQ(bytes(B),bytes(L));
+  EXPECT_EQ(spec::show_book(b),spec::show_book(L.decode()));
+  TempFile txt(str_bytes(text));
+  EXPECT_EQ(bytes(B),bytes(spec::BookView::load(txt.path)));
+}
+
+TEST(book,builtin) {
+  auto b = spec::builtin_book();
+  EXPECT_EQ(spec::show_book(b),spec::show_book(spec::BookView::encode(b).decode()));
+}
+
+TEST(book,parse_errors) {
+  for(str bad : {
+    "wts 10 g = 1 x\n", // a WTS offer buying gold
+    "wtb 1 x = 10 g\n", // a WTB offer not buying gold
+    "wts 0 x = 1 g\n", // empty offers
+    "wtb 10 g = 0 x\n",
+    "inv 99999999999999999999 g\n", // out of range
+    "filled 99999999999999999999\n",
+    "filled x\n",
+    "inv g\n",
+    "inv 1g\n",
+    "wts 1 x 1 g\n",
+    "buy 1 x = 1 g\n",
+  }) EXPECT_DEATH(spec::parse_book(bad),"book:1") << bad;
+  EXPECT_DEATH(spec::parse_changes("del 99999999999999999999\n"),"changes:1");
+}
+
+TEST(book,binary_errors) {
+  auto B = spec::BookView::encode(spec::parse_book(text));
+  auto load = [](const Bytes &data){ TempFile f(data); spec::BookView::load(f.path); };
+  auto data = bytes(B);
+  // Truncated.
+  for(size_t n : {size_t(8),sizeof(spec::BookView::Header),data.size()-1}) {
+    EXPECT_DEATH(load(Bytes(data.begin(),data.begin()+n)),"BookView") << n;
+  }
+  // A name index out of range.
+  auto off = B.offers();
+  size_t o = (const Byte*)off.begin()-B.bytes().begin();
+  ((spec::BookView::OfferRec*)(data.data()+o))->price.name = 100;
+  EXPECT_DEATH(load(data),"BookView: bad name index");
+  // A filled offer out of range.
+  data = bytes(B);
+  size_t f = (const Byte*)B.filled().begin()-B.bytes().begin();
+  *(uint32_t*)(data.data()+f) = 2;
+  EXPECT_DEATH(load(data),"BookView: bad filled offer");
+  // A WTS offer buying gold, encoded without the parser checks.
+  auto b = spec::parse_book(text);
+  b.wts.push_back({{"g",10},{"Hand Axe",1}});
+  EXPECT_DEATH(spec::BookView::encode(b),"has to buy gold");
+  b.wts.pop_back();
+  b.wtb.push_back({{"Hand Axe",1},{"g",10}});
+  EXPECT_DEATH(spec::BookView::encode(b),"has to buy gold");
+  b.wtb.pop_back();
+  b.wts[0].price.count = 0;
+  EXPECT_DEATH(spec::BookView::encode(b),"empty offer");
+}
@@ -0,0 +1,143 @@
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <condition_variable>
+#include "service.h"
+#include "utils/types.h"
+#include "utils/log.h"
+#include "utils/string.h"
+
+// Serves the queries of a Service over a Unix socket. The protocol is line based:
+// a query reads
+//   inv <count> <name>    -- any number of them, the other resources are 0
+//   solve <timeout_ms>    -- 0 = no timeout
+// and its answer is either
+//   plan <bytes> <done|timeout>
+//   <bytes of Plan::show_json()>
+// or
+//   error <message>
+// A client may send many queries before reading the answers: they are run
+// concurrently by the workers of the Service and answered in order.
+template<typename Bits, size_t R> struct Daemon {
+  using Service = ::Service<Bits,R>;
+  Daemon(Service &_service) : service(_service) {}
+
+  // Listens on the socket path, forever.
+  [[noreturn]] void serve(const str &path) {
+    int sock = socket(AF_UNIX,SOCK_STREAM,0);
+    if(sock<0) error("socket(): %",strerror(errno));
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if(path.size()>=sizeof addr.sun_path) error("socket path '%' is too long",path);
+    memcpy(addr.sun_path,path.c_str(),path.size()+1);
+    unlink(path.c_str());
+    if(bind(sock,(const sockaddr*)&addr,sizeof addr)) error("bind(%): %",path,strerror(errno));
+    if(listen(sock,SOMAXCONN)) error("listen(): %",strerror(errno));
+    info("serving % resources, % offers on %",service.S.names.size(),service.S.csr.edges(),path);
+    while(1) {
+      int fd = accept(sock,0,0);
+      if(fd<0){ info("accept(): %",strerror(errno)); continue; }
+      std::thread([this,fd]{ handle(fd); }).detach();
+    }
+  }
+
+private:
+  Service &service;
+
+  struct Pending {
+    std::future<typename Service::Answer> answer;
+    str error; // if not empty, the query is invalid
+  };
+
+  static bool send_all(int fd, const str &msg) {
+    for(size_t i=0; i<msg.size();) {
+      auto n = send(fd,msg.data()+i,msg.size()-i,MSG_NOSIGNAL);
+      if(n<0 && errno==EINTR) continue;
+      if(n<=0) return false;
+      i += n;
+    }
+    return true;
+  }
+
+  // The connection is read on this thread and the answers are written by another,
+  // as they become ready.
+  void handle(int fd) {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Pending> pending;
+    bool eof = false;
+    std::thread writer([&]{
+      bool ok = true;
+      while(1) {
+        Pending p;
+        {
+          std::unique_lock<std::mutex> L(mtx);
+          cv.wait(L,[&]{ return eof || pending.size(); });
+          if(pending.empty()) return;
+          p = std::move(pending.front());
+          pending.pop_front();
+        }
+        if(p.error.size()){ ok = ok && send_all(fd,util::fmt("error %\n",p.error)); continue; }
+        auto a = p.answer.get();
+        auto json = a.plan.show_json(service.S);
+        // The answers to a closed connection are still awaited, then dropped.
+        ok = ok && send_all(fd,util::fmt("plan % %\n%",json.size(),a.stopped ? "timeout" : "done",json));
+      }
+    });
+
+    auto push = [&](Pending p) {
+      { std::lock_guard<std::mutex> L(mtx); pending.push_back(std::move(p)); }
+      cv.notify_one();
+    };
+    FILE *in = fdopen(dup(fd),"r");
+    if(!in) error("fdopen(): %",strerror(errno));
+    auto &S = service.S;
+    vec<Units> inventory(S.names.size(),0);
+    str err;
+    char *buf = 0;
+    size_t cap = 0;
+    for(ssize_t n; (n = getline(&buf,&cap,in))>0;) {
+      std::string_view line(buf,n);
+      while(line.size() && isspace(line.back())) line.remove_suffix(1);
+      if(line.empty()) continue;
+      // Parses "<count> <rest>".
+      auto count = [](std::string_view &s, uint64_t &x) {
+        size_t i = 0;
+        for(x = 0; i<s.size() && isdigit(s[i]); i++) x = x*10+(s[i]-'0');
+        bool ok = i && i<=19 && (i==s.size() || s[i]==' ');
+        s.remove_prefix(std::min(i+1,s.size()));
+        return ok;
+      };
+      if(line.substr(0,4)=="inv ") {
+        auto s = line.substr(4);
+        uint64_t x;
+        if(!count(s,x) || s.empty()){ if(err.empty()) err = util::fmt("expected 'inv <count> <name>', got '%'",line); continue; }
+        auto r = S.names.find(s);
+        if(r==Dict::NONE){ if(err.empty()) err = util::fmt("unknown resource '%'",s); continue; }
+        inventory[r] += x;
+      } else if(line.substr(0,6)=="solve ") {
+        auto s = line.substr(6);
+        uint64_t ms;
+        if(!count(s,ms) || s.size()) err = util::fmt("expected 'solve <timeout_ms>', got '%'",line);
+        if(err.size()) push({{},err});
+        else push({service.submit({inventory,ms ? absl::Milliseconds(ms) : absl::InfiniteDuration()}),""});
+        std::fill(inventory.begin(),inventory.end(),0);
+        err.clear();
+      } else if(err.empty()) err = util::fmt("unknown command '%'",line);
+    }
+    free(buf);
+    fclose(in);
+    { std::lock_guard<std::mutex> L(mtx); eof = true; }
+    cv.notify_one();
+    writer.join();
+    close(fd);
+  }
+};
+
+#endif  // DAEMON_H_
@@ -0,0 +1,164 @@
+#ifndef DECOMPOSE_H_
+#define DECOMPOSE_H_
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <tuple>
+#include "solver.h"
+#include "reduce.h"
+#include "utils/types.h"
+#include "utils/log.h"
+#include "utils/string.h"
+#include "utils/parallel.h"
+
+// Decomposition of a Spec into sub-books which interact only through gold:
+// the connected components of trans without gold. The direction of the offers
+// does not matter, a resource shared by two offers couples them.
+// The components are searched separately and combined by a knapsack over the gold
+// and the transactions: they are run one after another, each from the gold and
+// within the transactions left by the previous ones, and after every component
+// the DP keeps the Pareto front of (offers filled, gold left, transactions used).
+// Every component is searched once per distinct (gold, transactions left) of
+// the front, on the given number of threads.
+// The combined plan is valid and within the depth limit, but a single search
+// may do better: it can interleave the components, to spend the gold of one offer
+// on another component before continuing. The components are run in the order
+// of their gold gain when searched alone from the starting gold, the gold makers first.
+struct Decomposition {
+  struct Component {
+    Spec spec;
+    Reduction map; // to the original Spec
+  };
+  vec<Component> components; // only the ones with a WTB offer
+
+  explicit Decomposition(const Spec &S) {
+    size_t n = S.trans.nodes.size();
+    vec<ResourceID> parent(n);
+    for(ResourceID r=0; r<n; r++) parent[r] = r;
+    auto find = [&](ResourceID r) {
+      while(parent[r]!=r) r = parent[r] = parent[parent[r]];
+      return r;
+    };
+    for(auto &node : S.trans.nodes) for(auto &e : node.out) {
+      if(e.from.res!=S.gold_id && e.to.res!=S.gold_id) parent[find(e.from.res)] = find(e.to.res);
+    }
+    vec<bool> filled(S.wtb_offers+S.wts_offers,false);
+    for(auto o : S.filled) filled[o] = true;
+    // Offers by the component of their non-gold end.
+    std::map<ResourceID,vec<OfferID>> offers;
+    for(auto &node : S.trans.nodes) for(auto &e : node.out) {
+      if(filled[e.offer]) continue;
+      offers[find(e.from.res!=S.gold_id ? e.from.res : e.to.res)].push_back(e.offer);
+    }
+    for(auto &[root,os] : offers) {
+      if(std::none_of(os.begin(),os.end(),[&](OfferID o){ return o<S.wtb_offers; })) continue;
+      vec<bool> keep(filled.size(),false);
+      for(auto o : os) keep[o] = true;
+      Component c;
+      c.map.resources = n;
+      c.map.offers = filled.size();
+      c.spec = sub_book(S,keep,c.map);
+      components.push_back(std::move(c));
+    }
+  }
+
+  str show() const {
+    vec<str> sizes;
+    for(auto &c : components) sizes.push_back(util::fmt("%/%",c.spec.names.size()-1,c.spec.wtb_offers+c.spec.wts_offers));
+    return util::fmt("% components (resources/offers): %",components.size(),util::join(" ",sizes));
+  }
+
+  // Searches the component c from the given inventory (indexed by the resources of c.spec),
+  // with at most depth_limit transactions, and returns the best plan.
+  // worker < threads; calls with the same worker do not overlap.
+  using Search = std::function<Plan(size_t worker, const Component &c, const vec<Units> &inventory, size_t depth_limit)>;
+
+  // Returns the combined plan for S, with the IDs of S, of at most depth_limit transactions.
+  Plan solve(const Spec &S, size_t threads, size_t depth_limit, const Search &search) const {
+    struct Result { size_t count; Units gold; size_t depth; Plan plan; };
+    // A search: the component, the starting gold and the transactions left.
+    using Job = std::tuple<size_t,Units,size_t>;
+    std::map<Job,Result> results;
+    auto run = [&](const vec<Job> &jobs) {
+      vec<Result> r(jobs.size());
+      util::parallel_for(jobs.size(),threads,[&](size_t worker, size_t i) {
+        auto [comp,gold,depth] = jobs[i];
+        auto &c = components[comp];
+        auto inv = c.spec.inventory;
+        inv[c.spec.gold_id] = gold;
+        auto p = search(worker,c,inv,depth);
+        if(p.steps.size()>depth) error("Decomposition::solve(): a plan of % transactions, % allowed",p.steps.size(),depth);
+        auto &end = p.steps.size() ? p.steps.back().inventory : p.inventory;
+        r[i] = {p.wtb_used_count,end[c.spec.gold_id],p.steps.size(),std::move(p)};
+      });
+      for(size_t i=0; i<jobs.size(); i++) results[jobs[i]] = std::move(r[i]);
+    };
+
+    Units gold = S.inventory[S.gold_id];
+    vec<Job> jobs;
+    for(size_t i=0; i<components.size(); i++) jobs.push_back({i,gold,depth_limit});
+    if(depth_limit) run(jobs);
+    vec<size_t> order(components.size());
+    for(size_t i=0; i<order.size(); i++) order[i] = i;
+    auto gain = [&](size_t i){ auto &r = results[{i,gold,depth_limit}]; return std::make_pair(r.gold,r.count); };
+    if(depth_limit) std::stable_sort(order.begin(),order.end(),[&](size_t a, size_t b){ return gain(a)>gain(b); });
+
+    // The DP: the Pareto front of (offers filled, gold left, transactions used).
+    // A point keeps its predecessor and the component searched from it, if any.
+    struct Point { size_t count; Units gold; size_t depth; size_t prev; size_t comp; };
+    static constexpr size_t NONE = size_t(-1);
+    vec<Point> points{{0,gold,0,NONE,NONE}};
+    vec<size_t> front{0};
+    auto job = [&](size_t c, const Point &p){ return Job{c,p.gold,depth_limit-p.depth}; };
+    for(auto c : order) {
+      jobs.clear();
+      for(auto p : front) if(points[p].depth<depth_limit && !results.count(job(c,points[p]))) jobs.push_back(job(c,points[p]));
+      std::sort(jobs.begin(),jobs.end());
+      jobs.erase(std::unique(jobs.begin(),jobs.end()),jobs.end());
+      run(jobs);
+      vec<size_t> next = front;
+      for(auto p : front) {
+        if(points[p].depth>=depth_limit) continue;
+        auto &r = results[job(c,points[p])];
+        if(!r.count) continue;
+        points.push_back({points[p].count+r.count,r.gold,points[p].depth+r.depth,p,c});
+        next.push_back(points.size()-1);
+      }
+      // The best first, so that a point can be dominated only by an earlier one.
+      auto key = [&](size_t p){ return std::make_tuple(points[p].count,points[p].gold,-int64_t(points[p].depth)); };
+      std::sort(next.begin(),next.end(),[&](size_t a, size_t b){ return key(a)>key(b); });
+      front.clear();
+      for(auto p : next) {
+        auto &x = points[p];
+        if(std::none_of(front.begin(),front.end(),[&](size_t q) {
+          auto &y = points[q];
+          return y.count>=x.count && y.gold>=x.gold && y.depth<=x.depth;
+        })) front.push_back(p);
+      }
+    }
+
+    // Concatenates the plans of the best point, replaying them on the inventory of S.
+    vec<size_t> chain;
+    for(size_t p = front[0]; p!=NONE; p = points[p].prev) if(points[p].comp!=NONE) chain.push_back(p);
+    Plan plan;
+    plan.inventory = S.inventory;
+    auto inv = S.inventory;
+    for(size_t k=chain.size(); k--;) {
+      auto &pt = points[chain[k]];
+      auto &c = components[pt.comp];
+      auto sub = c.map.expand(S,results[job(pt.comp,points[pt.prev])].plan);
+      if(inv[S.gold_id]!=sub.inventory[S.gold_id]) error("Decomposition::solve(): % gold, the plan starts with %",inv[S.gold_id],sub.inventory[S.gold_id]);
+      for(auto &st : sub.steps) {
+        inv[st.from] -= st.from_units;
+        inv[st.to] += st.to_units;
+        st.inventory = inv;
+        plan.steps.push_back(st);
+      }
+      plan.wtb_used_count += sub.wtb_used_count;
+    }
+    return plan;
+  }
+};
+
+#endif  // DECOMPOSE_H_
@@ -0,0 +1,47 @@
+#include "gtest/gtest.h"
+#include "solver.h"
+#include "decompose.h"
+#include "book.h"
+#include "utils/types.h"
+#include "utils/bitset.h"
+
+using Bits = util::Bitset<1>;
+constexpr size_t R = 16;
+
+// Two components, {a,b} filling one offer in 3 transactions and {c} filling
+// one in 2, each leaving 5 of the 10 gold.
+static const char *book = R"(
+inv 10 g
+wtb 5 g = 1 b
+wtb 5 g = 1 c
+wts 1 a = 1 g
+wts 1 b = 1 a
+wts 1 c = 1 g
+)";
+
+static Plan search(const Spec &S, const vec<Units> &inventory, size_t depth_limit) {
+  DFS<Bits,R> dfs(S,inventory,depth_limit);
+  dfs.bound = std::make_shared<Bound>(S);
+  dfs.result->verbose = false;
+  dfs.run(1);
+  return dfs.plan();
+}
+
+TEST(decompose,components) {
+  auto S = make_spec(spec::BookView::encode(spec::parse_book(book)));
+  Decomposition D(S);
+  EXPECT_EQ(2,D.components.size());
+}
+
+TEST(decompose,depth_limit) {
+  auto S = make_spec(spec::BookView::encode(spec::parse_book(book)));
+  Decomposition D(S);
+  for(size_t depth_limit=0; depth_limit<=6; depth_limit++) {
+    auto plan = D.solve(S,1,depth_limit,[&](size_t, const Decomposition::Component &c, const vec<Units> &inventory, size_t d) {
+      return search(c.spec,inventory,d);
+    });
+    EXPECT_LE(plan.steps.size(),depth_limit);
+    EXPECT_EQ(search(S,S.inventory,depth_limit).wtb_used_count,plan.wtb_used_count) << depth_limit;
+    EXPECT_EQ(depth_limit>=5 ? 2 : depth_limit>=2 ? 1 : 0,plan.wtb_used_count) << depth_limit;
+  }
+}
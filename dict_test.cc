@@ -0,0 +1,43 @@
+#include "gtest/gtest.h"
+#include "solver.h"
+#include "utils/types.h"
+
+TEST(dict,lookup) {
+  Dict D;
+  EXPECT_EQ(Dict::NONE,D.find("g"));
+  EXPECT_EQ(0,D.lookup("g"));
+  EXPECT_EQ(1,D.lookup("wood"));
+  EXPECT_EQ(0,D.lookup("g"));
+  EXPECT_EQ(1,D.find("wood"));
+  EXPECT_EQ(2,D.size());
+  EXPECT_EQ("wood",D.lookup_name(1));
+}
+
+TEST(dict,grow) {
+  // Many names, so that both the arena and the index are reallocated.
+  Dict D;
+  for(size_t i=0; i<1000; i++) ASSERT_EQ(i,D.lookup(util::fmt("name%",i)));
+  for(size_t i=0; i<1000; i++) {
+    ASSERT_EQ(i,D.find(util::fmt("name%",i)));
+    ASSERT_EQ(util::fmt("name%",i),D.lookup_name(i));
+  }
+}
+
+TEST(dict,lookup_all) {
+  Dict D;
+  D.lookup("b");
+  vec<str> names{"a","b","c","a"};
+  auto ids = D.lookup_all(names.size(),[&](size_t i){ return names[i]; });
+  EXPECT_EQ((vec<ResourceID>{1,0,2,1}),ids);
+  EXPECT_EQ(3,D.size());
+}
+
+TEST(dict,copy) {
+  Dict D;
+  for(size_t i=0; i<100; i++) D.lookup(util::fmt("name%",i));
+  Dict E = D;
+  D = Dict();
+  // The names of the copy point into its own arena.
+  for(size_t i=0; i<100; i++) ASSERT_EQ(util::fmt("name%",i),E.lookup_name(i));
+  EXPECT_EQ(50,E.find("name50"));
+}
@@ -0,0 +1,165 @@
+#ifndef GOLD_H_
+#define GOLD_H_
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include "solver.h"
+#include "utils/types.h"
+#include "utils/log.h"
+#include "utils/string.h"
+#include "utils/number_theory.h"
+#include "utils/parallel.h"
+
+// Maximizes the gold left at the end instead of the number of WTB offers filled,
+// optionally subject to a minimal number of them.
+// The trading model differs from the one of DFS: a WTS offer is applied any
+// number of times, instead of as many as the resources allow, so the plans
+// buy exactly what they need and cannot be replayed by State::Transaction.
+// The resources of the starting inventory other than gold are not used.
+//
+// First, for every open WTB offer, the cheapest chain of WTS offers from gold
+// to its units is found, by a DP over (resource, units needed):
+//   cost(gold,k) = k
+//   cost(r,k) = min over the offers e of r: cost(e.from.res, ceil(k/e.to.units)*e.from.units)
+// to a depth of max_chain offers (a memoized chain found with more depth left
+// may be longer). The offers are independent,
+// so they are split among the threads, each with its own memo.
+// Then the offers to fill are chosen by a 0/1 knapsack over the number of offers
+// filled: gold[c] is the most gold after filling c of the offers considered so far.
+// An offer is feasible iff the gold covers its cost. The offers are considered
+// in the order in which a set of them is best filled: the profitable ones by
+// increasing cost, then the others by decreasing payment. The table is a row of
+// O(offers) entries, updated in place per offer, plus a bit per (offer, count)
+// to recover the choice.
+struct GoldDP {
+  struct Options {
+    size_t threads = 1;
+    size_t min_offers = 0;
+    size_t max_chain = 8;
+  };
+  struct Result {
+    bool feasible = false; // min_offers can be filled
+    Units gold = 0; // at the end
+    Plan plan;
+  };
+
+  static Result solve(const Spec &S, const Options &opt) {
+    auto &C = S.csr;
+    vec<bool> filled(S.wtb_offers,false);
+    for(auto o : S.filled) filled[o] = true;
+    vec<EdgeID> wtb;
+    for(EdgeID e=0; e<C.edges(); e++) if(C.offer[e]<S.wtb_offers && !filled[C.offer[e]]) wtb.push_back(e);
+
+    // Cheapest chains, in parallel.
+    vec<Chain> chains(wtb.size());
+    size_t threads = std::max<size_t>(1,std::min(opt.threads,wtb.size()));
+    vec<std::unique_ptr<Acquire>> memo(threads);
+    util::parallel_for(wtb.size(),threads,[&](size_t worker, size_t i) {
+      if(!memo[worker]) memo[worker] = std::make_unique<Acquire>(S,opt.max_chain);
+      chains[i] = (*memo[worker])(C.from_res[wtb[i]],C.from_units[wtb[i]]);
+    });
+
+    struct Item { EdgeID e; const Chain *chain; Units pay; };
+    vec<Item> items;
+    // The costs fit the signed gold of the table.
+    for(size_t i=0; i<wtb.size(); i++) if(chains[i].cost<=Units(INT64_MAX)) items.push_back({wtb[i],&chains[i],C.to_units[wtb[i]]});
+    auto profitable = [](const Item &x){ return x.pay>=x.chain->cost; };
+    std::sort(items.begin(),items.end(),[&](const Item &a, const Item &b) {
+      if(profitable(a)!=profitable(b)) return profitable(a);
+      return profitable(a) ? a.chain->cost<b.chain->cost : a.pay>b.pay;
+    });
+
+    // The knapsack. gold[c] = -1: c offers cannot be filled.
+    size_t n = items.size();
+    vec<int64_t> gold(n+1,-1);
+    gold[0] = S.inventory[S.gold_id];
+    size_t words = (n+64)/64;
+    vec<uint64_t> took(n*words,0);
+    for(size_t i=0; i<n; i++) {
+      int64_t cost = items[i].chain->cost, net = int64_t(items[i].pay)-cost;
+      for(size_t c=i+1; c>0; c--) {
+        int64_t g = gold[c-1]>=cost ? gold[c-1]+net : -1;
+        bool take = g>gold[c];
+        gold[c] = take ? g : gold[c];
+        took[i*words+c/64] |= uint64_t(take)<<(c%64);
+      }
+    }
+
+    Result r;
+    size_t best = n+1;
+    for(size_t c=opt.min_offers; c<=n; c++) if(gold[c]>=0 && (best>n || gold[c]>gold[best])) best = c;
+    if(best>n) return r;
+    r.feasible = true;
+    r.gold = gold[best];
+    vec<size_t> chosen;
+    for(size_t i=n, c=best; i--;) if(took[i*words+c/64]>>(c%64)&1){ chosen.push_back(i); c--; }
+    std::reverse(chosen.begin(),chosen.end());
+
+    // The plan: every chain, then its WTB offer.
+    auto &p = r.plan;
+    p.inventory = S.inventory;
+    auto inv = S.inventory;
+    auto step = [&](EdgeID e, Units t) {
+      ResourceID from = C.from_res[e], to = C.to_res[e];
+      Units from_units = C.from_units[e]*t, to_units = C.to_units[e]*t;
+      if(inv[from]<from_units) error("GoldDP: % units of %, % needed",inv[from],from,from_units);
+      inv[from] -= from_units;
+      inv[to] += to_units;
+      p.steps.push_back({.offer = C.offer[e], .from = from, .to = to, .from_units = from_units, .to_units = to_units, .t = t, .inventory = inv});
+    };
+    for(auto i : chosen) {
+      for(auto [e,t] : items[i].chain->steps) step(e,t);
+      step(items[i].e,1);
+      p.wtb_used_count++;
+    }
+    return r;
+  }
+
+private:
+  static constexpr Units inf = std::numeric_limits<Units>::max();
+
+  // Offers applied t times, from gold, and their total cost in gold.
+  struct Chain {
+    Units cost = inf;
+    vec<std::pair<EdgeID,Units>> steps;
+  };
+
+  // The DP over (resource, units needed), memoized. A memo entry is reused
+  // only if it has been computed with no less depth left.
+  struct Acquire {
+    Acquire(const Spec &_S, size_t _max_chain) : S(_S), max_chain(_max_chain), in(S.names.size()) {
+      auto &C = S.csr;
+      for(EdgeID e=0; e<C.edges(); e++) if(C.offer[e]>=S.wtb_offers && C.to_res[e]!=S.gold_id) in[C.to_res[e]].push_back(e);
+    }
+    Chain operator()(ResourceID r, Units k) { return get(r,k,max_chain); }
+
+  private:
+    const Spec &S;
+    size_t max_chain;
+    vec<vec<EdgeID>> in; // WTS offers by item
+    struct Entry { size_t depth; Chain chain; };
+    std::map<std::pair<ResourceID,Units>,Entry> memo;
+
+    Chain get(ResourceID r, Units k, size_t depth) {
+      if(r==S.gold_id) return {k,{}};
+      if(!depth) return {};
+      if(auto it = memo.find({r,k}); it!=memo.end() && it->second.depth>=depth) return it->second.chain;
+      auto &C = S.csr;
+      Chain best;
+      for(auto e : in[r]) {
+        Units t = (k+C.to_units[e]-1)/C.to_units[e];
+        Units need = util::mul_sat(t,C.from_units[e]);
+        if(need==inf) continue;
+        auto c = get(C.from_res[e],need,depth-1);
+        if(c.cost>=best.cost) continue;
+        best = std::move(c);
+        best.steps.push_back({e,t});
+      }
+      memo[{r,k}] = {depth,best};
+      return best;
+    }
+  };
+};
+
+#endif  // GOLD_H_
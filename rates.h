@@ -0,0 +1,99 @@
+#ifndef RATES_H_
+#define RATES_H_
+
+#include <cmath>
+#include <limits>
+#include "solver.h"
+#include "utils/types.h"
+#include "utils/log.h"
+#include "utils/string.h"
+#include "utils/parallel.h"
+
+// Best exchange rates between all the pairs of resources, over chains of offers,
+// ignoring the integrality of the amounts: rate(i,j) is the most units of j
+// which a unit of i converts into. The WTB offers can be filled only once, so
+// they are left out unless wtb: a chain through them does not set a repeatable rate.
+// With the edge weights log(from_units)-log(to_units) the best rates are the
+// shortest paths, which are computed by Floyd-Warshall on a dense float matrix,
+// blocked into B x B tiles: for every diagonal tile, first the tile itself,
+// then its row and column of tiles, then all the others, in parallel.
+// The innermost loop is a min-plus update of a tile row, which the compiler
+// vectorizes. Resources on an arbitrage cycle (see Arbitrage) make the rates
+// through them unbounded: +infinity.
+// Memory is 4*n^2 bytes, time O(n^3): 0.05-0.3s for 1000 resources on a single SSE2 core.
+struct Rates {
+  static constexpr size_t B = 64; // tile size
+
+  explicit Rates(const Spec &S, size_t threads = 1, bool wtb = false) : n(S.csr.nodes()), stride((n+B-1)/B*B) {
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    d.assign(stride*stride,inf);
+    for(size_t i=0; i<n; i++) d[i*stride+i] = 0;
+    auto &C = S.csr;
+    for(EdgeID e=0; e<C.edges(); e++) {
+      if(!wtb && C.offer[e]<S.wtb_offers) continue;
+      auto &x = d[C.from_res[e]*stride+C.to_res[e]];
+      x = std::min(x,float(std::log(double(C.from_units[e]))-std::log(double(C.to_units[e]))));
+    }
+    size_t tiles = stride/B;
+    for(size_t k=0; k<tiles; k++) {
+      tile(k,k,k);
+      util::parallel_for(2*tiles,threads,[&](size_t, size_t t) {
+        size_t x = t/2;
+        if(x==k) return;
+        if(t%2) tile(k,x,k); else tile(x,k,k);
+      });
+      util::parallel_for(tiles*tiles,threads,[&](size_t, size_t t) {
+        size_t i = t/tiles, j = t%tiles;
+        if(i!=k && j!=k) tile(i,j,k);
+      });
+    }
+    unbound();
+  }
+
+  size_t n;
+  // Natural logarithm of rate(i,j): -infinity if j is not reachable from i.
+  INL float log_rate(ResourceID i, ResourceID j) const { return -d[i*stride+j]; }
+  INL double rate(ResourceID i, ResourceID j) const { return std::exp(double(log_rate(i,j))); }
+
+private:
+  size_t stride; // n rounded up to a multiple of B
+  vec<float> d; // d[i*stride+j] = -log_rate(i,j)
+
+  // Relaxes the tile (i,j) through the resources of the tile k.
+  void tile(size_t i, size_t j, size_t k) {
+    // A copy of the row of kk, so that the compiler knows it does not alias di.
+    alignas(64) float dk[B];
+    for(size_t kk=k*B; kk<k*B+B; kk++) {
+      std::copy(&d[kk*stride+j*B],&d[kk*stride+j*B]+B,dk);
+      for(size_t ii=i*B; ii<i*B+B; ii++) {
+        float *di = &d[ii*stride+j*B];
+        float a = d[ii*stride+kk];
+        if(a==std::numeric_limits<float>::infinity()) continue;
+        for(size_t jj=0; jj<B; jj++) di[jj] = std::min(di[jj],a+dk[jj]);
+      }
+    }
+  }
+
+  // Sets the rates through the resources on a negative cycle to +infinity.
+  // reach[k] is the bitset of the resources reachable from the k-th of them.
+  void unbound() {
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    vec<size_t> neg;
+    for(size_t k=0; k<n; k++) if(d[k*stride+k]<-1e-5) neg.push_back(k); // not a rounding error
+    if(neg.empty()) return;
+    size_t words = (n+63)/64;
+    vec<uint64_t> reach(neg.size()*words,0), to(words);
+    for(size_t x=0; x<neg.size(); x++) {
+      for(size_t j=0; j<n; j++) if(d[neg[x]*stride+j]<inf) reach[x*words+j/64] |= 1ull<<(j%64);
+    }
+    for(size_t i=0; i<n; i++) {
+      std::fill(to.begin(),to.end(),0);
+      for(size_t x=0; x<neg.size(); x++) if(d[i*stride+neg[x]]<inf) {
+        for(size_t w=0; w<words; w++) to[w] |= reach[x*words+w];
+      }
+      for(size_t j=0; j<n; j++) if(to[j/64]>>(j%64)&1) d[i*stride+j] = -inf;
+    }
+  }
+};
+
+#endif  // RATES_H_
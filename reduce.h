@@ -0,0 +1,142 @@
+#ifndef REDUCE_H_
+#define REDUCE_H_
+
+#include <algorithm>
+#include "solver.h"
+#include "utils/types.h"
+#include "utils/log.h"
+#include "utils/string.h"
+
+// Shrinking of a Spec before the search, for its starting inventory:
+// - unreachable: the offers whose price cannot be held. A resource can be held
+//   iff it is reachable in trans from a resource of the inventory. These
+//   offers are never applicable, so dropping them is exact.
+// - dead: the offers whose item cannot reach gold, i.e. not reachable
+//   from gold in trans.op(). The search only counts the WTB offers, so
+//   converting a resource into a dead one gains nothing.
+// - dominated: a WTS offer with the same price resource and item as another,
+//   which takes no fewer units for no more (ties are broken by the offer ID).
+// - filled: the WTB offers filled already.
+// The kept resources get dense IDs, gold first, and the kept offers too, WTB first.
+// The last two rules assume that more units of a resource never hurt, which
+// may fail in corner cases: a transaction converts as many units as it can.
+// Not applicable after a change of the Spec, nor to another inventory.
+struct Reduction {
+  vec<ResourceID> resource; // ID in the original Spec, per resource of the reduced one
+  vec<OfferID> offer; // ID in the original Spec, per offer of the reduced one
+  size_t resources = 0, offers = 0; // of the original Spec
+  size_t unreachable = 0, dead = 0, dominated = 0, filled = 0; // dropped offers, by the rule
+
+  str show() const {
+    return util::fmt("reduced % -> % resources, % -> % offers (dropped: % unreachable, % dead, % dominated, % filled)",
+      resources,resource.size(),offers,offer.size(),unreachable,dead,dominated,filled);
+  }
+
+  // Translates a plan for the reduced Spec to the original Spec S.
+  // The dropped resources keep their starting amounts.
+  Plan expand(const Spec &S, const Plan &p) const {
+    auto units = [&](const vec<Units> &v) {
+      vec<Units> x = S.inventory;
+      for(size_t i=0; i<v.size(); i++) x[resource[i]] = v[i];
+      return x;
+    };
+    Plan q;
+    q.inventory = units(p.inventory);
+    q.wtb_used_count = p.wtb_used_count;
+    for(auto st : p.steps) {
+      st.offer = offer[st.offer];
+      st.from = resource[st.from];
+      st.to = resource[st.to];
+      st.inventory = units(st.inventory);
+      q.steps.push_back(st);
+    }
+    return q;
+  }
+};
+
+// Returns the sub-book of S with the offers o such that keep[o], and r.resource, r.offer
+// set to its maps: gold and the resources of the kept offers, gold first, and the kept
+// offers, with dense IDs in the original order (so WTB first).
+static Spec sub_book(const Spec &S, const vec<bool> &keep, Reduction &r) {
+  auto &G = S.trans;
+  size_t n = G.nodes.size();
+  r.resource.clear();
+  r.offer.clear();
+  // Resources: gold and the ends of the kept offers.
+  vec<ResourceID> id(n,Dict::NONE);
+  r.resource.push_back(S.gold_id);
+  id[S.gold_id] = 0;
+  for(auto &node : G.nodes) for(auto &e : node.out) if(keep[e.offer]) {
+    for(auto x : {e.from.res,e.to.res}) if(id[x]==Dict::NONE){ id[x] = r.resource.size(); r.resource.push_back(x); }
+  }
+  vec<OfferID> offer_id(keep.size(),SpecChange::NONE);
+  Spec R;
+  R.wtb_offers = R.wts_offers = 0;
+  for(OfferID o=0; o<keep.size(); o++) if(keep[o]) {
+    offer_id[o] = r.offer.size();
+    r.offer.push_back(o);
+    (o<S.wtb_offers ? R.wtb_offers : R.wts_offers)++;
+  }
+
+  R.names.lookup_all(r.resource.size(),[&](size_t i){ return S.names.lookup_name(r.resource[i]); });
+  R.gold_id = 0;
+  R.trans.nodes.resize(r.resource.size());
+  for(auto &node : G.nodes) for(auto &e : node.out) if(keep[e.offer]) {
+    R.trans.add(Graph::Edge{
+      .from = {.res = id[e.from.res], .units = e.from.units},
+      .to = {.res = id[e.to.res], .units = e.to.units},
+      .offer = offer_id[e.offer],
+    });
+  }
+  for(auto x : r.resource) R.inventory.push_back(S.inventory[x]);
+  R.csr = CSR(R.trans);
+  R.zobrist = Zobrist(R.names.size(),R.wtb_offers,R.wtb_offers+R.wts_offers);
+  return R;
+}
+
+// Returns S reduced, as described by r.
+static Spec reduce(const Spec &S, Reduction &r) {
+  auto &G = S.trans;
+  size_t n = G.nodes.size();
+  r = Reduction();
+  r.resources = n;
+  r.offers = S.wtb_offers+S.wts_offers;
+  vec<ResourceID> roots;
+  for(ResourceID i=0; i<n; i++) if(S.inventory[i]) roots.push_back(i);
+  auto held = G.reach(roots);
+  auto alive = G.op().reach({S.gold_id});
+  vec<bool> filled(r.offers,false);
+  for(auto o : S.filled) filled[o] = true;
+
+  // keep[o] iff the offer o is kept.
+  vec<bool> keep(r.offers,false);
+  vec<Graph::Edge> group;
+  for(auto &node : G.nodes) {
+    group.clear();
+    for(auto &e : node.out) {
+      if(filled[e.offer]){ r.filled++; continue; }
+      if(!held[e.from.res]){ r.unreachable++; continue; }
+      if(!alive[e.to.res]){ r.dead++; continue; }
+      if(e.offer<S.wtb_offers){ keep[e.offer] = true; continue; }
+      group.push_back(e);
+    }
+    // By item, then from the cheapest price, then from the most units, so that
+    // an offer is dominated iff an earlier one of its item gives at least as many units.
+    std::sort(group.begin(),group.end(),[](const Graph::Edge &a, const Graph::Edge &b) {
+      return std::make_tuple(a.to.res,a.from.units,b.to.units,a.offer) < std::make_tuple(b.to.res,b.from.units,a.to.units,b.offer);
+    });
+    for(size_t i=0; i<group.size(); i++) {
+      auto &e = group[i];
+      if(i && group[i-1].to.res==e.to.res && group[i-1].to.units>=e.to.units) {
+        r.dominated++;
+        // The kept offer of the earlier ones gives the most units.
+        e.to.units = group[i-1].to.units;
+        continue;
+      }
+      keep[e.offer] = true;
+    }
+  }
+  return sub_book(S,keep,r);
+}
+
+#endif  // REDUCE_H_
@@ -1,245 +1,87 @@
-#include "spec.h"
+#include "solver.h"
+#include "arbitrage.h"
+#include "reduce.h"
+#include "rates.h"
+#include "decompose.h"
+#include "gold.h"
+#include "daemon.h"
+#include "book.h"
 #include "utils/types.h"
 #include "utils/log.h"
-#include "utils/string.h"
-#include <bit>
-#include <map>
+#include "utils/read_file.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
 #include <iostream>
-#include <queue>
+#include <thread>
 
-using ResourceID = uint64_t;
-using OfferID = size_t;
-using Units = uint64_t;
+ABSL_FLAG(size_t, threads, 1, "number of search threads (0 = all cores)");
+ABSL_FLAG(std::string, book, "", "offer book file, in the text or the binary form (default = builtin spec); the search supports at most 1024 WTB offers and 1024 resources");
+ABSL_FLAG(std::string, compile_book, "", "write the offer book in the binary form to this file and exit");
+ABSL_FLAG(bool, arbitrage, false, "report the profitable conversion cycles of the book and exit");
+ABSL_FLAG(bool, rates, false, "report the best exchange rates of every resource from gold and to gold, via a single WTB offer, and exit");
+ABSL_FLAG(bool, bnb, false, "exact branch-and-bound search, pruned by an upper bound on the offers left");
+ABSL_FLAG(size_t, depth_limit, 80, "maximal number of transactions");
+ABSL_FLAG(size_t, deepen_step, 0, "depth step of iterative deepening (0 = disabled)");
+ABSL_FLAG(absl::Duration, timeout, absl::InfiniteDuration(), "search time budget; the best solution found so far is reported");
+ABSL_FLAG(std::string, plan_out, "", "write the best plan as JSON to this file");
+ABSL_FLAG(size_t, lp_depth, 0, "nodes shallower than this are bounded and ordered by the LP relaxation");
+ABSL_FLAG(std::string, move_order, "history", "order of the moves: natural (by resource and offer ID), static (WTB offers first, then by gold valuation gain) or history (static, refined by the history and killer heuristics)");
+ABSL_FLAG(bool, por, true, "partial order reduction: search only one order of the commuting transactions");
+ABSL_FLAG(size_t, dominance, 0, "entries of the dominance table, per thread (0 = disabled); heuristic, see DominanceTable");
+ABSL_FLAG(bool, pareto, false, "keep the Pareto front of (offers filled, gold left, transactions), prune against it instead of by the heuristic depth rule, and report all of it; --plan_out gets its plans");
+ABSL_FLAG(size_t, tt_mb, 64, "size of the transposition table in MiB (0 = disabled)");
+ABSL_FLAG(std::string, socket, "", "serve the queries (starting inventories) on this Unix socket, see daemon.h");
+ABSL_FLAG(std::string, inventories, "", "search from each of the starting inventories in this file (see spec::parse_inventories) instead, in parallel");
+ABSL_FLAG(bool, reduce, false, "shrink the offer book for the starting inventory before the search, see reduce.h; not with --changes");
+ABSL_FLAG(bool, decompose, false, "search the components of the offer book which share only gold separately, see decompose.h; not with --changes");
+ABSL_FLAG(std::string, objective, "offers", "what the search maximizes: offers (the number of WTB offers filled) or gold (the gold left, by a DP with its own trading model, see gold.h); gold not with --changes");
+ABSL_FLAG(size_t, min_offers, 0, "with --objective=gold: the least number of WTB offers to fill");
+ABSL_FLAG(std::string, changes, "", "file of offer book changes, applied one by one after the search, each followed by an incremental re-search");
 
-struct Dict {
-  ResourceID lookup(str name) {
-    if(!name_to_id.count(name)) {
-      auto id = name_to_id.size();
-      name_to_id[name] = id;
-      id_to_name[id] = name;
-    }
-    return name_to_id[name];
-  }
-  str lookup_name(ResourceID id) const {
-    return id_to_name.at(id);
-  }
-  size_t size() const { return name_to_id.size(); }
-private:
-  std::map<str,ResourceID> name_to_id;
-  std::map<ResourceID,str> id_to_name;
-};
-
-struct Graph {
-  struct End {
-    ResourceID res; Units units;
-    friend str show(const End &e){ return util::fmt("%x [%]",e.units,e.res); }
-  };
-  struct Edge {
-    End from,to; OfferID offer;
-    friend str show(const Edge &e){ return util::fmt("(%) -%> (%)",show(e.from),e.offer,show(e.to)); }
-  };
-  struct Node { vec<Edge> out,in; };
-  vec<Node> nodes;
-  void add(Edge e) {
-    nodes[e.from.res].out.push_back(e);
-    nodes[e.to.res].in.push_back(e);
-  }
-
-  vec<ResourceID> topo() const {
-    vec<size_t> out_deg(nodes.size());
-    vec<ResourceID> Q;
-    for(size_t i=0; i<nodes.size(); i++) {
-      if(!(out_deg[i] = nodes[i].out.size())) Q.push_back(i);
-    }
-    vec<ResourceID> res;
-    while(Q.size()) {
-      auto id = Q.back();
-      Q.pop_back();
-      res.push_back(id);
-      for(auto e : nodes[id].in) {
-        if(!out_deg[e.from.res]--) Q.push_back(e.from.res);
-      }
-    }
-    return res;
-  }
-
-  struct Dist {
-    ResourceID res;
-    uint64_t dist;
-    Units mod;
-    bool operator<(const Dist &b) const {
-      if(dist!=b.dist){ return dist>b.dist; }
-      return mod<b.mod;
-    }
-  };
-  vec<Dist> dij(ResourceID root) const {
-    std::priority_queue<Dist> Q;
-    vec<Dist> D(nodes.size());
-    vec<bool> V(nodes.size(),0);
-    Q.push({root,1});
-    while(Q.size()) {
-      auto d = Q.top(); Q.pop();
-      if(V[d.res]) continue;
-      V[d.res] = 1;
-      D[d.res] = d;
-      for(auto &e : nodes[d.res].out) {
-        auto m = d.mod ? d.mod : e.from.units;
-        Q.push({e.to.res,d.dist*e.from.units,m});
-      }
-    }
-    return D;
-  }
-
-  Graph op() const {
-    Graph G = *this;
-    for(auto &n : G.nodes){
-      std::swap(n.in,n.out);
-      for(auto &e : n.in) std::swap(e.from,e.to);
-      for(auto &e : n.out) std::swap(e.from,e.to);
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc,argv);
+  util::StreamLogger _(std::cerr);
+#ifdef PROFILE
+  // Reports the profile at every return from main(), before the logger goes.
+  // The worker threads have flushed their profiles at exit.
+  struct ProfileReport {
+    ~ProfileReport() {
+      profile.flush();
+      info("profile:\n%",Profile::total().show());
     }
-    return G;
-  }
-};
-
-struct Spec {
-  Dict names;
-  ResourceID gold_id;
-  size_t wtb_offers;
-  size_t wts_offers;
-  Graph trans; 
-};
-
-static Spec make_spec() { 
-  Spec S;
-  S.gold_id = S.names.lookup("g");
-  auto wts = spec::WTS();
-  auto wtb = spec::WTB();
-  S.wts_offers = wts.size();
-  S.wtb_offers = wtb.size();
-  auto ts = wtb;
-  ts.insert(ts.end(),wts.begin(),wts.end());
-  for(auto offer : ts) {
-    S.names.lookup(offer.obj.name);
-    S.names.lookup(offer.price.name);
+  } profile_report;
+#endif
+  auto book_path = absl::GetFlag(FLAGS_book);
+  auto B = book_path.size() ? spec::BookView::load(book_path) : spec::BookView::encode(spec::builtin_book());
+  if(auto out = absl::GetFlag(FLAGS_compile_book); out.size()) {
+    auto b = B.bytes();
+    util::write_file(out,Bytes(b.begin(),b.end()));
+    info("written % offers to %",B.offers().size(),out);
+    return 0;
   }
-  S.trans.nodes.resize(S.names.size());
-  for(size_t i=0; i<ts.size(); i++) {
-    S.trans.add(Graph::Edge{
-      .from = {.res = S.names.lookup(ts[i].price.name), .units = ts[i].price.count},
-      .to = {.res = S.names.lookup(ts[i].obj.name), .units = ts[i].obj.count},
-      .offer = i,
-    });
-  }
-  return S;
-}
-
-
-struct State {
-  const Spec &S;
-  vec<uint64_t> resources_avail;
-  uint64_t wtb_used = 7766969575;
-  size_t wtb_used_count = 0;
-  size_t depth = 0;
-  uint64_t allowed_mask = 1; // {gold}
-
-  INL bool is_allowed(ResourceID res) const { return (allowed_mask>>res)&1; }
-  INL void update_allowed(ResourceID a, ResourceID b) {
-    auto m = ~((1ull<<std::max(a,b))-1);
-    allowed_mask = (m&allowed_mask)|(1ull<<a)|(1ull<<b);
-  }
-
-  friend str show(const State &s) {
-    str wtb_used_bits = "";
-    for(size_t i=0; i<s.S.wtb_offers; i++) wtb_used_bits += ((s.wtb_used>>i)&1) ? '1' : '0';
-
-    str allowed_mask_bits = "";
-    for(size_t i=0; i<s.S.names.size(); i++) allowed_mask_bits += ((s.allowed_mask>>i)&1) ? '1' : '0';
-
-    vec<str> res;
-    for(auto x : s.resources_avail) res.push_back(util::to_str(x));
-    return util::fmt("{ depth = %; allowed_mask = %; wtb_used = (%) %; resources = {%} }",s.depth,allowed_mask_bits,s.wtb_used,wtb_used_bits,util::join(",",res));
-  }
-
-  struct Transaction {
-    State &s;
-    const Graph::Edge &e;
-    bool ok = 0;
-    
-    Units t;
-    bool is_gold;
-    uint64_t prev_allowed_mask;
-
-    INL operator bool(){ return ok; }
-    INL Transaction(State &_s, const Graph::Edge &_e) : s(_s), e(_e) {
-      //if(!s.is_allowed(e.from.res) && !s.is_allowed(e.to.res)) return;
-      auto got = s.resources_avail[e.from.res];
-      if(got<e.from.units) return;
-      is_gold = (e.to.res==s.S.gold_id);
-      t = is_gold ? !bool(s.wtb_used&(1ull<<e.offer)) : got/e.from.units;
-      if(!t) return;
-
-      ok = 1;
-      if(is_gold) {
-        s.wtb_used |= 1ull<<e.offer;
-        s.wtb_used_count++;
-      }
-      s.depth++;
-      prev_allowed_mask = s.allowed_mask;
-      s.update_allowed(e.from.res,e.to.res);
-      s.resources_avail[e.to.res] += e.to.units*t;
-      s.resources_avail[e.from.res] -= e.from.units*t;
-    }
-    INL ~Transaction() {
-      if(!ok) return;
-      if(is_gold) {
-        s.wtb_used &= ~(1ull<<e.offer);
-        s.wtb_used_count--;
-      }
-      s.depth--;
-      s.allowed_mask = prev_allowed_mask;
-      s.resources_avail[e.to.res] -= e.to.units*t;
-      s.resources_avail[e.from.res] += e.from.units*t; 
-    }
-  };
-};
-
-struct DFS {
-  DFS(const Spec &_S, size_t _depth_limit) : state{_S}, depth_limit(_depth_limit) {
-    state.resources_avail = {125,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,2,0,0,0,0,0,1,0,0,0};
-    //state.resources_avail.resize(_S.names.size(),0);
-    //state.resources_avail[_S.gold_id] = 125;
+  Spec S = make_spec(B);
+  if(absl::GetFlag(FLAGS_arbitrage)) {
+    auto cycles = Arbitrage::find(S);
+    for(auto &c : cycles) info("%",Arbitrage::show(S,c));
+    info("% arbitrage cycles",cycles.size());
+    return 0;
   }
-  State state;
-  
-  size_t depth_limit = 0;
-  size_t best = 0;
-  
-  void run() {
-    //info("state = %",show(state));
-    if(state.wtb_used_count>best) {
-      best = state.wtb_used_count;
-      info("% % transactions done %",state.wtb_used,state.wtb_used_count,show(state));
-    }
-    if(state.depth>state.wtb_used_count*4+7) return;
-    auto &trans_nodes = state.S.trans.nodes;
-    for(size_t i=state.resources_avail.size();i--;) {
-      auto got = state.resources_avail[i];
-      if(got==0) continue;
-      for(auto &e : trans_nodes[i].out) {
-        State::Transaction T(state,e);
-        if(!T) continue;
-        //info("%",show(e));
-        run();
-      }
+  if(absl::GetFlag(FLAGS_rates)) {
+    auto start = realtime_sec();
+    size_t threads = absl::GetFlag(FLAGS_threads);
+    Rates R(S,threads ? threads : std::thread::hardware_concurrency());
+    info("all-pairs rates of % resources in %s",R.n,realtime_sec()-start);
+    // Best gold per unit of r, converted to the item of an open WTB offer.
+    vec<double> sell(R.n,0);
+    vec<bool> filled(S.wtb_offers,false);
+    for(auto o : S.filled) filled[o] = true;
+    auto &G = S.trans.nodes[S.gold_id];
+    for(ResourceID r=0; r<R.n; r++) for(auto &e : G.in) if(!filled[e.offer]) {
+      sell[r] = std::max(sell[r],R.rate(r,e.from.res)*e.to.units/e.from.units);
     }
+    for(ResourceID r=0; r<R.n; r++) info("%: % per g, sells for % g",S.names.lookup_name(r),R.rate(S.gold_id,r),sell[r]);
+    return 0;
   }
-};
-
-
-
-int main() {
-  util::StreamLogger _(std::cerr);
-  Spec S = make_spec();
 
   /*auto D = S.trans.dij(S.gold_id);
   Graph G;
@@ -260,9 +102,201 @@ int main() {
   util::info("{ % }",util::join(", ",nodes));
   */
 
-  DFS dfs(S,80);
-  dfs.run();
-  info("done");
+  auto move_order = absl::GetFlag(FLAGS_move_order);
+  if(move_order!="natural" && move_order!="static" && move_order!="history") error("unknown --move_order=%",move_order);
+  size_t threads = absl::GetFlag(FLAGS_threads);
+  if(!threads) threads = std::thread::hardware_concurrency();
+  auto service_options = [&](auto &opt) {
+    opt.threads = threads;
+    opt.depth_limit = absl::GetFlag(FLAGS_depth_limit);
+    opt.tt_bytes = (absl::GetFlag(FLAGS_tt_mb)<<20)/threads;
+    opt.bnb = absl::GetFlag(FLAGS_bnb);
+    opt.lp_depth = absl::GetFlag(FLAGS_lp_depth);
+    opt.move_order = move_order!="natural";
+    opt.use_history = move_order=="history";
+    opt.por = absl::GetFlag(FLAGS_por);
+    opt.dominance = absl::GetFlag(FLAGS_dominance);
+  };
+  if(auto path = absl::GetFlag(FLAGS_socket); path.size()) {
+    with_state(S.wtb_offers,S.names.size(),[&](auto bits, auto cap) {
+      using Service = ::Service<decltype(bits),decltype(cap)::value>;
+      typename Service::Options opt;
+      service_options(opt);
+      Service service(S,opt);
+      Daemon<decltype(bits),decltype(cap)::value>(service).serve(path);
+    });
+  }
+  if(auto path = absl::GetFlag(FLAGS_inventories); path.size()) {
+    auto invs = spec::parse_inventories(util::to_str(util::read_file(path)));
+    with_state(S.wtb_offers,S.names.size(),[&](auto bits, auto cap) {
+      using Service = ::Service<decltype(bits),decltype(cap)::value>;
+      typename Service::Options opt;
+      service_options(opt);
+      Service service(S,opt);
+      vec<typename Service::Query> queries(invs.size());
+      for(size_t i=0; i<invs.size(); i++) {
+        auto &q = queries[i];
+        q.inventory.assign(S.names.size(),0);
+        for(auto &x : invs[i]) {
+          auto r = S.names.find(x.name);
+          if(r==Dict::NONE) error("inventory %: unknown resource '%'",i,x.name);
+          q.inventory[r] += x.count;
+        }
+        q.timeout = absl::GetFlag(FLAGS_timeout);
+      }
+      auto start = realtime_sec();
+      auto answers = service.batch(queries);
+      vec<str> plans;
+      for(size_t i=0; i<answers.size(); i++) {
+        auto &a = answers[i];
+        info("inventory %: % best = % (%s, % nodes)",i,a.stopped ? "timeout;" : "done;",a.plan.wtb_used_count,a.time,a.nodes);
+        plans.push_back(a.plan.show_json(S));
+      }
+      info("% inventories in %s",invs.size(),realtime_sec()-start);
+      if(auto out = absl::GetFlag(FLAGS_plan_out); out.size()) util::write_file(out,util::to_bytes("[\n"+util::join(",\n",plans)+"]\n"));
+    });
+    return 0;
+  }
+
+  vec<spec::BookChange> changes;
+  if(auto path = absl::GetFlag(FLAGS_changes); path.size()) changes = spec::parse_changes(util::to_str(util::read_file(path)));
+  // The search runs on the reduced S and the plans are reported for the full one.
+  Spec full;
+  Reduction reduction;
+  bool reduced = absl::GetFlag(FLAGS_reduce);
+  if(reduced) {
+    if(changes.size()) error("--reduce does not support --changes");
+    full = S;
+    auto start = realtime_sec();
+    S = reduce(full,reduction);
+    info("% (%s)",reduction.show(),realtime_sec()-start);
+  }
+  auto report = [&](const Plan &p){ return reduced ? reduction.expand(full,p) : p; };
+  auto json = [&](const Plan &p){ return reduced ? report(p).show_json(full) : p.show_json(S); };
+  auto write_plan = [&](const Plan &p) {
+    if(auto out = absl::GetFlag(FLAGS_plan_out); out.size()) util::write_file(out,util::to_bytes(json(p)));
+  };
+  // The options of the DFS, other than the ones which depend on the Spec.
+  auto dfs_options = [&](auto &dfs) {
+    dfs.use_history = move_order=="history";
+    dfs.por = absl::GetFlag(FLAGS_por);
+    dfs.dominance = absl::GetFlag(FLAGS_dominance);
+  };
+  auto timeout_ctx = [&]{
+    auto ctx = Ctx::background();
+    if(auto t = absl::GetFlag(FLAGS_timeout); t!=absl::InfiniteDuration()) ctx = Ctx::with_timeout(ctx,t);
+    return ctx;
+  };
+
+  if(auto objective = absl::GetFlag(FLAGS_objective); objective!="offers") {
+    if(objective!="gold") error("unknown --objective=%",objective);
+    if(changes.size()) error("--objective=gold does not support --changes");
+    GoldDP::Options opt;
+    opt.threads = threads;
+    opt.min_offers = absl::GetFlag(FLAGS_min_offers);
+    auto start = realtime_sec();
+    auto r = GoldDP::solve(S,opt);
+    if(!r.feasible){ info("cannot fill % offers (%s)",opt.min_offers,realtime_sec()-start); return 0; }
+    info("done; best gold = % with % offers (%s)",r.gold,r.plan.wtb_used_count,realtime_sec()-start);
+    info("plan = %",show(report(r.plan)));
+    write_plan(r.plan);
+    return 0;
+  }
+  if(absl::GetFlag(FLAGS_decompose)) {
+    if(changes.size()) error("--decompose does not support --changes");
+    if(absl::GetFlag(FLAGS_pareto)) error("--decompose does not support --pareto");
+    Decomposition D(S);
+    info("%",D.show());
+    // The components are searched in parallel, one per thread, so every thread owns a transposition table.
+    vec<std::shared_ptr<TransTable>> tts(threads);
+    auto ctx = timeout_ctx();
+    auto start = realtime_sec();
+    std::atomic<size_t> nodes{0};
+    auto plan = D.solve(S,threads,absl::GetFlag(FLAGS_depth_limit),[&](size_t worker, const Decomposition::Component &c, const vec<Units> &inventory, size_t depth_limit) {
+      return with_state(c.spec.wtb_offers,c.spec.names.size(),[&](auto bits, auto cap) {
+        DFS<decltype(bits),decltype(cap)::value> dfs(c.spec,inventory,depth_limit,ctx);
+        if(auto mb = absl::GetFlag(FLAGS_tt_mb)) {
+          if(!tts[worker]) tts[worker] = std::make_shared<TransTable>((mb<<20)/threads);
+          tts[worker]->clear();
+          dfs.tt = tts[worker];
+        }
+        if(absl::GetFlag(FLAGS_bnb)) dfs.bound = std::make_shared<Bound>(c.spec);
+        if(move_order!="natural") dfs.order = std::make_shared<EdgeOrder>(c.spec);
+        dfs_options(dfs);
+        dfs.result->verbose = false;
+        dfs.run(1);
+        nodes += dfs.nodes_visited();
+        return dfs.plan();
+      });
+    });
+    info("% best = % (%s, % nodes)",ctx->done() ? "timeout;" : "done;",plan.wtb_used_count,realtime_sec()-start,nodes.load());
+    info("plan = %",show(report(plan)));
+    write_plan(plan);
+    return 0;
+  }
+  // Every change adds at most 1 WTB offer or 2 resources.
+  with_state(S.wtb_offers+changes.size(),S.names.size()+2*changes.size(),[&](auto bits, auto cap) {
+    std::shared_ptr<TransTable> tt;
+    if(auto mb = absl::GetFlag(FLAGS_tt_mb)) tt = std::make_shared<TransTable>(mb<<20);
+    std::shared_ptr<Bound> bound;
+    if(absl::GetFlag(FLAGS_bnb)) bound = std::make_shared<Bound>(S);
+    Plan plan;
+    vec<Plan> front; // of the last search, if --pareto
+    // Searches S. After the change of S, the search is warm-started from the previous plan.
+    auto solve = [&](const SpecChange *change) {
+      auto ctx = timeout_ctx();
+      DFS<decltype(bits),decltype(cap)::value> dfs(S,absl::GetFlag(FLAGS_depth_limit),ctx);
+      dfs.tt = tt;
+      dfs.bound = bound;
+      if(move_order!="natural") dfs.order = std::make_shared<EdgeOrder>(S);
+      dfs_options(dfs);
+      if(absl::GetFlag(FLAGS_pareto)) dfs.front = std::make_shared<ParetoFront>(S);
+      if(auto d = absl::GetFlag(FLAGS_lp_depth)) {
+        auto lp = std::make_shared<FlowBound>(S);
+        if(lp->enabled) {
+          dfs.lp = lp;
+          dfs.lp_depth = d;
+          Path plan;
+          auto n = lp->solve(dfs.state,plan);
+          info("LP relaxation: at most % offers, fractional plan uses % edges",n,plan.size());
+        }
+      }
+      // The warm start counts too: it may find the best solution already.
+      auto start = realtime_sec();
+      if(change) {
+        auto seeded = dfs.warm_start(plan,*change);
+        info("warm start: % of % offers kept",seeded,plan.wtb_used_count);
+        if(seeded<plan.wtb_used_count && tt){ info("transposition table cleared"); tt->clear(); }
+      }
+      if(auto step = absl::GetFlag(FLAGS_deepen_step)) dfs.deepen(threads,step);
+      else dfs.run(threads);
+      info("% best = % (%s, % nodes; found after %s)",dfs.stopped() ? "timeout;" : "done;",dfs.best(),realtime_sec()-start,dfs.nodes_visited(),
+        dfs.best() ? dfs.result->best_time-start : 0.);
+      plan = dfs.plan();
+      info("plan = %",show(report(plan)));
+      if(dfs.front) {
+        front.clear();
+        for(auto &p : dfs.front->points()) {
+          front.push_back(Plan::trace(dfs.state,p.path));
+          info("front: % offers, % gold, % transactions: %",p.count,p.gold,p.depth,show(report(front.back())));
+        }
+        info("% points on the Pareto front",front.size());
+      }
+    };
+    solve(0);
+    for(auto &c : changes) {
+      auto change = c.del ? remove_offer(S,c.id) : add_offer(S,c.offer,c.wtb);
+      info("% offer %: % rekeyed resources",change.added ? "added" : "removed",show(change.edge),change.rekeyed);
+      if(bound) bound->update(S,change);
+      solve(&change);
+    }
+    if(front.empty()) write_plan(plan);
+    else if(auto out = absl::GetFlag(FLAGS_plan_out); out.size()) {
+      vec<str> plans;
+      for(auto &p : front) plans.push_back(json(p));
+      util::write_file(out,util::to_bytes("[\n"+util::join(",\n",plans)+"]\n"));
+    }
+  });
 
   return 0;
 }
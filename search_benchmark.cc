@@ -0,0 +1,340 @@
+// Benchmarks of the search hot paths on synthetic offer books.
+// Use --benchmark_format=json (or --benchmark_out=<file>) for machine-readable results.
+// Every benchmark reports the peak heap use of its allocations as the peak_heap counter.
+#include "benchmark/benchmark.h"
+#include "solver.h"
+#include "arbitrage.h"
+#include "reduce.h"
+#include "rates.h"
+#include "decompose.h"
+#include "gold.h"
+#include "service.h"
+#include "book.h"
+#include "utils/types.h"
+#include "utils/string.h"
+#include "utils/bitset.h"
+#include <random>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Heap use of the benchmarks. The global operator new and delete are replaced
+// by counting ones, which keep the size of a block in a header in front of it.
+namespace heap {
+std::atomic<size_t> used{0}, peak{0};
+
+static void* alloc(size_t n, size_t align) {
+  size_t header = std::max(align,alignof(std::max_align_t));
+  auto *p = (char*)aligned_alloc(align,(header+n+align-1)/align*align);
+  if(!p) throw std::bad_alloc();
+  p += header;
+  ((size_t*)p)[-1] = n;
+  size_t u = used += n, m = peak.load();
+  while(u>m && !peak.compare_exchange_weak(m,u));
+  return p;
+}
+
+static void release(void *p, size_t align) {
+  if(!p) return;
+  used -= ((size_t*)p)[-1];
+  std::free((char*)p-std::max(align,alignof(std::max_align_t)));
+}
+
+// Reports the peak heap use of a benchmark, over the allocations made
+// during its lifetime, as the peak_heap counter.
+struct Peak {
+  benchmark::State &bs;
+  size_t base = used.load();
+  explicit Peak(benchmark::State &_bs) : bs(_bs) { peak = base; }
+  ~Peak(){ bs.counters["peak_heap"] = benchmark::Counter(peak-base,benchmark::Counter::kDefaults,benchmark::Counter::kIs1024); }
+};
+}  // namespace heap
+
+void* operator new(size_t n) { return heap::alloc(n,alignof(std::max_align_t)); }
+void* operator new(size_t n, std::align_val_t a) { return heap::alloc(n,size_t(a)); }
+void operator delete(void *p) noexcept { heap::release(p,alignof(std::max_align_t)); }
+void operator delete(void *p, size_t) noexcept { heap::release(p,alignof(std::max_align_t)); }
+void operator delete(void *p, std::align_val_t a) noexcept { heap::release(p,size_t(a)); }
+void operator delete(void *p, size_t, std::align_val_t a) noexcept { heap::release(p,size_t(a)); }
+
+// Synthetic offer book. The items are split into depth layers: layer 0 items
+// are sold for gold, layer k items for layer k-1 items, and about wtb_pct
+// percent of the items are bought for gold, the deeper the more expensively.
+static spec::Book synthetic_book(size_t resources, size_t offers, size_t depth, size_t wtb_pct, uint64_t seed = 1) {
+  std::mt19937_64 rng(seed);
+  auto rnd = [&](size_t n){ return size_t(rng()%n); };
+  auto name = [](size_t i){ return util::fmt("item %",i); };
+  depth = std::max<size_t>(1,std::min(depth,resources));
+  auto layer = [&](size_t i){ return i*depth/resources; };
+  vec<vec<size_t>> layers(depth);
+  for(size_t i=0; i<resources; i++) layers[layer(i)].push_back(i);
+
+  spec::Book b;
+  b.inventory = {{"g",100}};
+  for(size_t k=0; k<offers; k++) {
+    auto to = rnd(resources);
+    auto &prev = layers[layer(to)-!!layer(to)];
+    auto price = layer(to) ? spec::Obj{name(prev[rnd(prev.size())]),1+rnd(5)} : spec::Obj{"g",1+rnd(10)};
+    b.wts.push_back({{name(to),1},price});
+  }
+  for(size_t i=0; i<resources; i++) {
+    if(rnd(100)<wtb_pct) b.wtb.push_back({{"g",5+rnd(50*(layer(i)+1))},{name(i),1+rnd(3)}});
+  }
+  return b;
+}
+
+// Union of the given number of synthetic books, sharing only gold.
+static spec::Book disjoint_books(size_t parts, size_t resources, size_t offers, size_t depth, size_t wtb_pct) {
+  spec::Book b;
+  b.inventory = {{"g",100}};
+  for(size_t p=0; p<parts; p++) {
+    auto x = synthetic_book(resources,offers,depth,wtb_pct,p+1);
+    auto rename = [&](spec::Obj o){ if(o.name!="g") o.name = util::fmt("%/%",p,o.name); return o; };
+    for(auto &o : x.wts) b.wts.push_back({rename(o.obj),rename(o.price)});
+    for(auto &o : x.wtb) b.wtb.push_back({rename(o.obj),rename(o.price)});
+  }
+  return b;
+}
+
+// Bits and resource capacity R wide enough for all the benchmarked books.
+using Bits = util::Bitset<4>;
+constexpr size_t R = 256;
+
+static void BM_MakeSpec(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto B = spec::BookView::encode(synthetic_book(bs.range(0),bs.range(1),4,20));
+  for(auto _ : bs) benchmark::DoNotOptimize(make_spec(B));
+  bs.SetItemsProcessed(bs.iterations()*B.offers().size());
+}
+BENCHMARK(BM_MakeSpec)->Args({100,1000})->Args({1000,100000})->Args({10000,1000000})->Unit(benchmark::kMillisecond);
+
+// Apply and undo of every transaction applicable to the starting inventory.
+static void BM_Transaction(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(synthetic_book(bs.range(0),bs.range(1),4,20)));
+  DFS<Bits,R> dfs(S,1);
+  auto &C = S.csr;
+  vec<std::pair<ResourceID,EdgeID>> edges;
+  for(ResourceID r=0; r<C.nodes(); r++) if(dfs.state.resources_avail[r]) {
+    for(EdgeID e=C.begin[r]; e<C.begin[r+1]; e++) edges.push_back({r,e});
+  }
+  for(auto _ : bs) {
+    for(auto [r,e] : edges) {
+      DFS<Bits,R>::State::Transaction T(dfs.state,r,e);
+      benchmark::DoNotOptimize(T.ok);
+    }
+  }
+  bs.SetItemsProcessed(bs.iterations()*edges.size());
+}
+BENCHMARK(BM_Transaction)->Args({20,100})->Args({200,2000});
+
+static void BM_Arbitrage(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(synthetic_book(bs.range(0),bs.range(1),4,20)));
+  size_t cycles = 0;
+  for(auto _ : bs) cycles = Arbitrage::find(S).size();
+  bs.counters["cycles"] = cycles;
+}
+BENCHMARK(BM_Arbitrage)->Args({100,1000})->Args({1000,10000})->Unit(benchmark::kMillisecond);
+
+static void BM_Preprocess(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(synthetic_book(bs.range(0),bs.range(1),4,20)));
+  Reduction r;
+  for(auto _ : bs) benchmark::DoNotOptimize(reduce(S,r));
+  bs.counters["resources"] = r.resource.size();
+  bs.counters["offers"] = r.offer.size();
+}
+BENCHMARK(BM_Preprocess)->Args({100,1000})->Args({1000,100000})->Unit(benchmark::kMillisecond);
+
+// All-pairs rates. Args: resources, offers, threads.
+static void BM_Rates(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(synthetic_book(bs.range(0),bs.range(1),4,20)));
+  for(auto _ : bs) benchmark::DoNotOptimize(Rates(S,bs.range(2)));
+}
+BENCHMARK(BM_Rates)->Args({100,1000,1})->Args({1000,10000,1})->Args({1000,10000,4})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The gold maximizing plan. Args: resources, offers, threads.
+static void BM_Gold(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(synthetic_book(bs.range(0),bs.range(1),4,20)));
+  GoldDP::Options opt;
+  opt.threads = bs.range(2);
+  GoldDP::Result r;
+  for(auto _ : bs) r = GoldDP::solve(S,opt);
+  bs.counters["gold"] = r.gold;
+  bs.counters["offers"] = r.plan.wtb_used_count;
+}
+BENCHMARK(BM_Gold)->Args({100,1000,1})->Args({1000,10000,1})->Args({1000,10000,4})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Full search. Args: resources, offers, conversion chain depth, WTB density [%], depth_limit,
+// move order (0 = natural, 1 = static, 2 = history).
+static void BM_Search(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(synthetic_book(bs.range(0),bs.range(1),bs.range(2),bs.range(3))));
+  auto order = bs.range(5) ? std::make_shared<EdgeOrder>(S) : nullptr;
+  size_t nodes = 0, best = 0;
+  double first = 0, optimal = 0;
+  for(auto _ : bs) {
+    bs.PauseTiming();
+    DFS<Bits,R> dfs(S,bs.range(4));
+    dfs.tt = std::make_shared<TransTable>(16<<20);
+    dfs.order = order;
+    dfs.use_history = bs.range(5)==2;
+    dfs.result->verbose = false;
+    auto start = realtime_sec();
+    bs.ResumeTiming();
+    dfs.run(1);
+    nodes += dfs.nodes_visited();
+    best = dfs.best();
+    if(best) {
+      first += dfs.result->first_time-start;
+      optimal += dfs.result->best_time-start;
+    }
+  }
+  bs.counters["nodes/s"] = benchmark::Counter(nodes,benchmark::Counter::kIsRate);
+  bs.counters["best"] = best;
+  bs.counters["first_s"] = benchmark::Counter(first,benchmark::Counter::kAvgIterations);
+  bs.counters["optimal_s"] = benchmark::Counter(optimal,benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_Search)
+  ->ArgsProduct({{20},{60},{3},{30},{8},{0,1,2}})
+  ->ArgsProduct({{40},{200},{4},{30},{6},{0,1,2}})
+  ->ArgsProduct({{60},{300},{6},{10},{6},{0,1,2}})
+  ->ArgsProduct({{100},{1000},{2},{50},{4},{0,1,2}})
+  ->Unit(benchmark::kMillisecond);
+
+// Exact search with the reductions of the search tree. Arg: 0 = none,
+// 1 = partial order reduction, 2 = also dominance pruning.
+static void BM_Reduce(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(synthetic_book(15,40,3,30)));
+  auto bound = std::make_shared<Bound>(S);
+  size_t nodes = 0, best = 0;
+  for(auto _ : bs) {
+    DFS<Bits,R> dfs(S,10);
+    dfs.tt = std::make_shared<TransTable>(16<<20);
+    dfs.bound = bound;
+    dfs.por = bs.range(0)>=1;
+    dfs.dominance = bs.range(0)>=2 ? 1<<16 : 0;
+    dfs.result->verbose = false;
+    dfs.run(1);
+    nodes += dfs.nodes_visited();
+    best = dfs.best();
+  }
+  bs.counters["nodes"] = benchmark::Counter(nodes,benchmark::Counter::kAvgIterations);
+  bs.counters["best"] = best;
+}
+BENCHMARK(BM_Reduce)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMillisecond);
+
+// Exact search of the Pareto front of (offers filled, gold left, transactions). Arg: depth limit.
+static void BM_Pareto(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(synthetic_book(15,40,3,30)));
+  auto bound = std::make_shared<Bound>(S);
+  size_t nodes = 0, points = 0;
+  for(auto _ : bs) {
+    DFS<Bits,R> dfs(S,bs.range(0));
+    dfs.tt = std::make_shared<TransTable>(16<<20);
+    dfs.bound = bound;
+    dfs.por = true;
+    dfs.front = std::make_shared<ParetoFront>(S);
+    dfs.result->verbose = false;
+    dfs.run(1);
+    nodes += dfs.nodes_visited();
+    points = dfs.front->points().size();
+  }
+  bs.counters["nodes"] = benchmark::Counter(nodes,benchmark::Counter::kAvgIterations);
+  bs.counters["points"] = points;
+}
+BENCHMARK(BM_Pareto)->Arg(6)->Arg(8)->Unit(benchmark::kMillisecond);
+
+// Exact search of 3 disjoint books, by components. Arg: threads.
+static void BM_Decompose(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(disjoint_books(3,15,40,3,30)));
+  Decomposition D(S);
+  size_t best = 0;
+  for(auto _ : bs) {
+    auto plan = D.solve(S,bs.range(0),10,[&](size_t, const Decomposition::Component &c, const vec<Units> &inventory, size_t depth_limit) {
+      DFS<Bits,R> dfs(c.spec,inventory,depth_limit);
+      dfs.tt = std::make_shared<TransTable>(4<<20);
+      dfs.bound = std::make_shared<Bound>(c.spec);
+      dfs.result->verbose = false;
+      dfs.run(1);
+      return dfs.plan();
+    });
+    best = plan.wtb_used_count;
+  }
+  bs.counters["components"] = D.components.size();
+  bs.counters["best"] = best;
+}
+BENCHMARK(BM_Decompose)->Arg(1)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Re-search after a change of the book by one offer. Args: the change,
+// 0 = an offer of the middle step of the best plan is removed, so that a part
+// of the tree changes, 1 = an offer off the best plan is removed, so that the
+// plan and the transposition table stay valid; 0 = cold search, 1 = warm start.
+// The setup dominates the iterations, hence their fixed number.
+static void BM_Resolve(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S0 = make_spec(spec::BookView::encode(synthetic_book(40,200,4,30)));
+  size_t nodes = 0, seeded = 0, best = 0;
+  for(auto _ : bs) {
+    bs.PauseTiming();
+    Spec S = S0;
+    auto tt = std::make_shared<TransTable>(16<<20);
+    DFS<Bits,R> prev(S,6);
+    prev.tt = tt;
+    prev.result->verbose = false;
+    prev.run(1);
+    auto plan = prev.plan();
+    if(plan.steps.empty()){ bs.SkipWithError("no plan to change"); break; }
+    OfferID o = plan.steps[plan.steps.size()/2].offer;
+    if(bs.range(0)) {
+      vec<bool> used(S.wtb_offers+S.wts_offers,false);
+      for(auto &st : plan.steps) used[st.offer] = true;
+      o = std::find(used.begin()+S.wtb_offers,used.end(),false)-used.begin();
+    }
+    auto change = remove_offer(S,o);
+    bs.ResumeTiming();
+    DFS<Bits,R> dfs(S,6);
+    if(bs.range(1)) {
+      dfs.tt = tt;
+      seeded = dfs.warm_start(plan,change);
+      if(seeded<plan.wtb_used_count) tt->clear();
+    } else dfs.tt = std::make_shared<TransTable>(16<<20);
+    dfs.result->verbose = false;
+    dfs.run(1);
+    nodes += dfs.nodes_visited();
+    best = dfs.best();
+  }
+  bs.counters["nodes"] = benchmark::Counter(nodes,benchmark::Counter::kAvgIterations);
+  bs.counters["seeded"] = seeded;
+  bs.counters["best"] = best;
+}
+BENCHMARK(BM_Resolve)->ArgsProduct({{0,1},{0,1}})->Iterations(3)->Unit(benchmark::kMillisecond);
+
+// Searches from N random inventories on a Service. Args: N, threads.
+static void BM_Batch(benchmark::State &bs) {
+  heap::Peak _(bs);
+  auto S = make_spec(spec::BookView::encode(synthetic_book(20,60,3,30)));
+  Service<Bits,R>::Options opt;
+  opt.threads = bs.range(1);
+  opt.depth_limit = 5;
+  opt.tt_bytes = 4<<20;
+  Service<Bits,R> service(S,opt);
+  std::mt19937_64 rng(1);
+  vec<Service<Bits,R>::Query> queries(bs.range(0));
+  for(auto &q : queries) {
+    q.inventory.assign(S.names.size(),0);
+    q.inventory[S.gold_id] = 10+rng()%30;
+    for(int i=0; i<3; i++) q.inventory[rng()%S.names.size()] += 1+rng()%3;
+  }
+  for(auto _ : bs) benchmark::DoNotOptimize(service.batch(queries));
+  bs.SetItemsProcessed(bs.iterations()*queries.size());
+}
+BENCHMARK(BM_Batch)->Args({200,1})->Args({200,4})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
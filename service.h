@@ -0,0 +1,129 @@
+#ifndef SERVICE_H_
+#define SERVICE_H_
+
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "solver.h"
+#include "utils/types.h"
+#include "utils/log.h"
+#include "utils/ctx.h"
+
+// Search service over a fixed Spec, for many queries with different starting inventories.
+// The Spec and the caches which do not depend on the inventory (the Bound,
+// the LP of FlowBound and the EdgeOrder) stay resident, and the queries are run by a fixed pool
+// of workers, one query per worker.
+// Every worker owns a transposition table, which is cleared (in O(1)) between
+// the queries, since the entries of one search are not valid for another.
+template<typename Bits, size_t R> struct Service {
+  struct Options {
+    size_t threads = 1;
+    size_t depth_limit = 80;
+    size_t tt_bytes = 0; // per worker, 0 = no transposition table
+    bool bnb = false;
+    size_t lp_depth = 0; // see DFS::lp_depth
+    bool move_order = true; // see DFS::order
+    bool use_history = true;
+    bool por = true; // see DFS::por
+    size_t dominance = 0; // see DFS::dominance
+  };
+  struct Query {
+    vec<Units> inventory; // indexed by ResourceID
+    absl::Duration timeout = absl::InfiniteDuration();
+  };
+  struct Answer {
+    Plan plan;
+    bool stopped = false; // by the timeout
+    size_t nodes = 0;
+    double time = 0; // from submit() to the answer, in seconds
+  };
+
+  Service(const Spec &_S, Options _opt) : S(_S), opt(_opt) {
+    if(opt.bnb) bound = std::make_shared<Bound>(S);
+    if(opt.lp_depth) {
+      auto l = std::make_shared<FlowBound>(S);
+      if(l->enabled) lp = l;
+    }
+    if(opt.move_order) order = std::make_shared<EdgeOrder>(S);
+    for(size_t i=0; i<opt.threads; i++) workers.emplace_back([this]{ work(); });
+  }
+  // Answers the queries submitted already.
+  ~Service() {
+    { std::lock_guard<std::mutex> L(mtx); closed = true; }
+    cv.notify_all();
+    for(auto &w : workers) w.join();
+  }
+
+  const Spec &S;
+
+  std::future<Answer> submit(Query q) {
+    if(q.inventory.size()!=S.names.size()) error("Service: inventory of % resources, want %",q.inventory.size(),S.names.size());
+    Job j{std::move(q),{},realtime_sec()};
+    auto f = j.answer.get_future();
+    { std::lock_guard<std::mutex> L(mtx); jobs.push_back(std::move(j)); }
+    cv.notify_one();
+    return f;
+  }
+
+  // Runs the queries and returns their answers, in order.
+  vec<Answer> batch(vec<Query> qs) {
+    vec<std::future<Answer>> f;
+    for(auto &q : qs) f.push_back(submit(std::move(q)));
+    vec<Answer> a;
+    for(auto &x : f) a.push_back(x.get());
+    return a;
+  }
+
+private:
+  struct Job {
+    Query q;
+    std::promise<Answer> answer;
+    double start;
+  };
+  Options opt;
+  std::shared_ptr<const Bound> bound;
+  std::shared_ptr<const FlowBound> lp;
+  std::shared_ptr<const EdgeOrder> order;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<Job> jobs;
+  bool closed = false;
+  vec<std::thread> workers;
+
+  void work() {
+    std::shared_ptr<TransTable> tt;
+    if(opt.tt_bytes) tt = std::make_shared<TransTable>(opt.tt_bytes);
+    while(1) {
+      Job j;
+      {
+        std::unique_lock<std::mutex> L(mtx);
+        cv.wait(L,[&]{ return closed || jobs.size(); });
+        if(jobs.empty()) return;
+        j = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      Ctx::Ptr ctx;
+      if(j.q.timeout!=absl::InfiniteDuration()) ctx = Ctx::with_timeout(Ctx::background(),j.q.timeout);
+      DFS<Bits,R> dfs(S,j.q.inventory,opt.depth_limit,ctx);
+      if(tt){ tt->clear(); dfs.tt = tt; }
+      dfs.bound = bound;
+      if(lp){ dfs.lp = lp; dfs.lp_depth = opt.lp_depth; }
+      dfs.order = order;
+      dfs.use_history = opt.use_history;
+      dfs.por = opt.por;
+      dfs.dominance = opt.dominance;
+      dfs.result->verbose = false;
+      dfs.run(1);
+      Answer a;
+      a.plan = dfs.plan();
+      a.stopped = dfs.stopped();
+      a.nodes = dfs.nodes_visited();
+      a.time = realtime_sec()-j.start;
+      j.answer.set_value(std::move(a));
+    }
+  }
+};
+
+#endif  // SERVICE_H_
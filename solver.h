@@ -0,0 +1,1348 @@
+#ifndef SOLVER_H_
+#define SOLVER_H_
+
+#include "book.h"
+#include "utils/types.h"
+#include "utils/log.h"
+#include "utils/string.h"
+#include "utils/bitset.h"
+#include "utils/fixed_vec.h"
+#include "utils/ctx.h"
+#include "utils/simplex.h"
+#include "utils/number_theory.h"
+#include <map>
+#include <string_view>
+#include <queue>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <limits>
+
+using ResourceID = uint64_t;
+using OfferID = size_t;
+using Units = uint64_t;
+
+// Interned names of the resources.
+// All the names are stored in a single arena and id_to_name points into it,
+// name_to_id is an open-addressing (linear probing) hash index over the IDs.
+struct Dict {
+  Dict() {}
+  Dict(const Dict &d) : arena(d.arena), index(d.index), id_to_name(d.id_to_name) { rebase(d.arena.data()); }
+  Dict(Dict&&) = default;
+  Dict& operator=(Dict d){ std::swap(arena,d.arena); std::swap(index,d.index); std::swap(id_to_name,d.id_to_name); return *this; }
+
+  static constexpr ResourceID NONE = ResourceID(-1);
+
+  // Returns the ID of name, or NONE if it has not been interned.
+  ResourceID find(std::string_view name) const { return find(name,std::hash<std::string_view>()(name)); }
+
+  ResourceID lookup(std::string_view name) {
+    auto h = std::hash<std::string_view>()(name);
+    if(auto id = find(name,h); id!=NONE) return id;
+    ResourceID id = id_to_name.size();
+    if(2*(id+1)>index.size()) grow_index();
+    insert_index(h,id);
+    id_to_name.push_back(append(name));
+    return id;
+  }
+
+  // Bulk insert of the names name(0),...,name(n-1).
+  // Reserves the arena and the index upfront, so that it is linear in the total length.
+  template<typename F> vec<ResourceID> lookup_all(size_t n, F name) {
+    size_t bytes = 0;
+    for(size_t i=0; i<n; i++) bytes += std::string_view(name(i)).size();
+    reserve_arena(arena.size()+bytes);
+    id_to_name.reserve(id_to_name.size()+n);
+    while(index.size()<2*(id_to_name.size()+n)) grow_index();
+    vec<ResourceID> ids(n);
+    for(size_t i=0; i<n; i++) ids[i] = lookup(name(i));
+    return ids;
+  }
+
+  std::string_view lookup_name(ResourceID id) const {
+    return id_to_name.at(id);
+  }
+  size_t size() const { return id_to_name.size(); }
+private:
+  struct Slot { uint32_t id1 = 0; uint32_t tag = 0; }; // id1 = ID+1, 0 = empty
+  vec<char> arena;
+  vec<Slot> index;
+  vec<std::string_view> id_to_name;
+
+  ResourceID find(std::string_view name, size_t h) const {
+    if(index.size()) for(size_t i=h&(index.size()-1); index[i].id1; i=(i+1)&(index.size()-1)) {
+      if(index[i].tag==uint32_t(h) && id_to_name[index[i].id1-1]==name) return index[i].id1-1;
+    }
+    return NONE;
+  }
+
+  void insert_index(size_t h, ResourceID id) {
+    size_t i = h&(index.size()-1);
+    while(index[i].id1) i = (i+1)&(index.size()-1);
+    index[i] = {uint32_t(id+1),uint32_t(h)};
+  }
+  void grow_index() {
+    index = vec<Slot>(index.size() ? 2*index.size() : 16);
+    for(size_t id=0; id<id_to_name.size(); id++) insert_index(std::hash<std::string_view>()(id_to_name[id]),id);
+  }
+
+  std::string_view append(std::string_view name) {
+    if(arena.size()+name.size()>arena.capacity()) reserve_arena(std::max(2*arena.capacity(),arena.size()+name.size()));
+    auto b = arena.size();
+    arena.insert(arena.end(),name.begin(),name.end());
+    return std::string_view(arena.data()+b,name.size());
+  }
+  void reserve_arena(size_t n) {
+    if(n<=arena.capacity()) return;
+    auto old = arena.data();
+    arena.reserve(n);
+    rebase(old);
+  }
+  // Moves id_to_name to the current arena buffer.
+  void rebase(const char *old) {
+    for(auto &s : id_to_name) s = std::string_view(arena.data()+(s.data()-old),s.size());
+  }
+};
+
+struct Graph {
+  struct End {
+    ResourceID res; Units units;
+    friend str show(const End &e){ return util::fmt("%x [%]",e.units,e.res); }
+  };
+  struct Edge {
+    End from,to; OfferID offer;
+    friend str show(const Edge &e){ return util::fmt("(%) -%> (%)",show(e.from),e.offer,show(e.to)); }
+  };
+  struct Node { vec<Edge> out,in; };
+  vec<Node> nodes;
+  void add(Edge e) {
+    nodes[e.from.res].out.push_back(e);
+    nodes[e.to.res].in.push_back(e);
+  }
+
+  vec<ResourceID> topo() const {
+    vec<size_t> out_deg(nodes.size());
+    vec<ResourceID> Q;
+    for(size_t i=0; i<nodes.size(); i++) {
+      if(!(out_deg[i] = nodes[i].out.size())) Q.push_back(i);
+    }
+    vec<ResourceID> res;
+    while(Q.size()) {
+      auto id = Q.back();
+      Q.pop_back();
+      res.push_back(id);
+      for(auto e : nodes[id].in) {
+        if(!out_deg[e.from.res]--) Q.push_back(e.from.res);
+      }
+    }
+    return res;
+  }
+
+  // reach(roots)[r] iff r is reachable from a root.
+  vec<bool> reach(const vec<ResourceID> &roots) const {
+    vec<bool> seen(nodes.size(),false);
+    vec<ResourceID> Q;
+    for(auto r : roots) if(!seen[r]){ seen[r] = true; Q.push_back(r); }
+    while(Q.size()) {
+      auto r = Q.back(); Q.pop_back();
+      for(auto &e : nodes[r].out) if(!seen[e.to.res]){ seen[e.to.res] = true; Q.push_back(e.to.res); }
+    }
+    return seen;
+  }
+
+  struct Dist {
+    ResourceID res;
+    uint64_t dist; // saturated at 2^64-1
+    Units mod;
+    bool operator<(const Dist &b) const {
+      if(dist!=b.dist){ return dist>b.dist; }
+      return mod<b.mod;
+    }
+  };
+  vec<Dist> dij(ResourceID root) const;
+
+  Graph op() const {
+    Graph G = *this;
+    for(auto &n : G.nodes){
+      std::swap(n.in,n.out);
+      for(auto &e : n.in) std::swap(e.from,e.to);
+      for(auto &e : n.out) std::swap(e.from,e.to);
+    }
+    return G;
+  }
+};
+
+using EdgeID = uint32_t;
+using Path = vec<EdgeID>;
+
+// Frozen compressed sparse row form of the outgoing edges of a Graph.
+// Edges out of resource r are [begin[r],begin[r+1]), in the order of Graph::Node::out,
+// stored as a structure of arrays, so that the DFS loop over them reads
+// only the arrays it needs, sequentially.
+struct CSR {
+  CSR() {}
+  explicit CSR(const Graph &G) {
+    begin.push_back(0);
+    for(size_t r=0; r<G.nodes.size(); r++) {
+      for(auto &e : G.nodes[r].out) {
+        from_res.push_back(e.from.res);
+        from_units.push_back(e.from.units);
+        to_res.push_back(e.to.res);
+        to_units.push_back(e.to.units);
+        offer.push_back(e.offer);
+      }
+      begin.push_back(from_res.size());
+    }
+  }
+  vec<EdgeID> begin;
+  vec<uint32_t> from_res;
+  vec<Units> from_units;
+  vec<uint32_t> to_res;
+  vec<Units> to_units;
+  vec<uint32_t> offer;
+
+  size_t nodes() const { return begin.size()-1; }
+  size_t edges() const { return from_res.size(); }
+  str show_edge(EdgeID e) const {
+    return util::fmt("(%x [%]) -%> (%x [%])",from_units[e],from_res[e],offer[e],to_units[e],to_res[e]);
+  }
+
+  vec<Graph::Dist> dij(ResourceID root) const {
+    using Dist = Graph::Dist;
+    std::priority_queue<Dist> Q;
+    vec<Dist> D(nodes());
+    vec<bool> V(nodes(),0);
+    Q.push({root,1,0});
+    while(Q.size()) {
+      auto d = Q.top(); Q.pop();
+      if(V[d.res]) continue;
+      V[d.res] = 1;
+      D[d.res] = d;
+      for(EdgeID e=begin[d.res]; e<begin[d.res+1]; e++) {
+        auto m = d.mod ? d.mod : from_units[e];
+        Q.push({to_res[e],util::mul_sat(d.dist,from_units[e]),m});
+      }
+    }
+    return D;
+  }
+};
+
+inline vec<Graph::Dist> Graph::dij(ResourceID root) const { return CSR(*this).dij(root); }
+
+// Keys of the incremental state hash:
+// hash = sum_r res[r]*resources_avail[r] + sum_{o in wtb_used} offer[o]  (mod 2^64).
+// Being linear, it is updated in O(1) per transaction.
+// last[o] marks the offer o of the last transaction in the transposition
+// table keys under partial order reduction, see DFS::run(). Like offer,
+// it is indexed by OfferID, so it follows the offers through SpecChange.
+struct Zobrist {
+  vec<uint64_t> res, offer, last;
+  Zobrist() {}
+  Zobrist(size_t resources, size_t wtb_offers, size_t offers) {
+    for(size_t i=0; i<resources; i++) res.push_back(key());
+    for(size_t i=0; i<wtb_offers; i++) offer.push_back(key());
+    for(size_t i=0; i<offers; i++) last.push_back(key());
+  }
+  // Fresh key, unlike all the previous ones (w.h.p.).
+  uint64_t key(){ return splitmix64(seed); }
+private:
+  uint64_t seed = 0x5eed;
+  static uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15);
+    z = (z^(z>>30))*0xbf58476d1ce4e5b9;
+    z = (z^(z>>27))*0x94d049bb133111eb;
+    return z^(z>>31);
+  }
+};
+
+struct Spec {
+  Dict names;
+  ResourceID gold_id;
+  size_t wtb_offers;
+  size_t wts_offers;
+  Graph trans; 
+  CSR csr; // frozen trans
+  Zobrist zobrist;
+  vec<Units> inventory; // starting resources_avail
+  vec<OfferID> filled; // WTB offers filled already
+};
+
+static Spec make_spec(const spec::BookView &B) { 
+  Spec S;
+  S.gold_id = S.names.lookup(spec::gold);
+  S.wts_offers = B.wts();
+  S.wtb_offers = B.wtb();
+  auto ids = S.names.lookup_all(B.names(),[&](size_t i){ return B.name(i); });
+  S.trans.nodes.resize(S.names.size());
+  auto offers = B.offers();
+  for(size_t i=0; i<offers.size(); i++) {
+    S.trans.add(Graph::Edge{
+      .from = {.res = ids[offers[i].price.name], .units = offers[i].price.count},
+      .to = {.res = ids[offers[i].obj.name], .units = offers[i].obj.count},
+      .offer = i,
+    });
+  }
+  S.inventory.resize(S.names.size(),0);
+  for(auto &x : B.inventory()) S.inventory[ids[x.name]] += x.count;
+  S.filled.assign(B.filled().begin(),B.filled().end());
+  S.csr = CSR(S.trans);
+  S.zobrist = Zobrist(S.names.size(),S.wtb_offers,S.wtb_offers+S.wts_offers);
+  return S;
+}
+
+// Change of a live Spec by a single offer, see add_offer() and remove_offer().
+// OfferIDs stay dense, with the WTB offers first, so the offers after
+// the changed one are renumbered; remap() translates the old IDs.
+struct SpecChange {
+  static constexpr OfferID NONE = OfferID(-1);
+  Graph::Edge edge; // the added offer, with its new ID, or the removed one, with its old ID
+  bool added;
+  bool wtb;
+  size_t rekeyed = 0; // resources whose Zobrist keys have been replaced
+
+  // Returns the ID of the old offer o after the change, or NONE if it has been removed.
+  OfferID remap(OfferID o) const {
+    if(added) return o>=edge.offer ? o+1 : o;
+    if(o==edge.offer) return NONE;
+    return o>edge.offer ? o-1 : o;
+  }
+
+  // Applies remap() to the offers of S.
+  void renumber(Spec &S) const {
+    for(auto &n : S.trans.nodes) {
+      for(auto &e : n.out) e.offer = remap(e.offer);
+      for(auto &e : n.in) e.offer = remap(e.offer);
+    }
+    vec<OfferID> filled;
+    for(auto o : S.filled) if(auto x = remap(o); x!=NONE) filled.push_back(x);
+    S.filled = filled;
+  }
+
+  // An added offer extends the subtree of a state iff the state holds a resource
+  // from which its price is reachable. The keys of these resources are replaced,
+  // so that the hashes of exactly the affected states change, and their
+  // transposition table entries are not found anymore.
+  void rekey(Spec &S) {
+    vec<bool> seen(S.trans.nodes.size(),false);
+    vec<ResourceID> Q{edge.from.res};
+    seen[edge.from.res] = true;
+    while(Q.size()) {
+      auto r = Q.back(); Q.pop_back();
+      S.zobrist.res[r] = S.zobrist.key();
+      rekeyed++;
+      for(auto &e : S.trans.nodes[r].in) if(!seen[e.from.res]){ seen[e.from.res] = true; Q.push_back(e.from.res); }
+    }
+  }
+};
+
+// Adds the offer o (a WTB one iff wtb) to S. Resources seen for the first time are added too.
+static SpecChange add_offer(Spec &S, const spec::Offer &o, bool wtb) {
+  auto id = [&](const str &name) {
+    auto r = S.names.lookup(name);
+    if(r==S.trans.nodes.size()) {
+      S.trans.nodes.emplace_back();
+      S.inventory.push_back(0);
+      S.zobrist.res.push_back(S.zobrist.key());
+    }
+    return r;
+  };
+  SpecChange c{
+    .edge = {
+      .from = {.res = id(o.price.name), .units = o.price.count},
+      .to = {.res = id(o.obj.name), .units = o.obj.count},
+      .offer = wtb ? S.wtb_offers : S.wtb_offers+S.wts_offers,
+    },
+    .added = true,
+    .wtb = wtb,
+  };
+  if(!c.edge.from.units || !c.edge.to.units) error("add_offer(): empty offer %",show(c.edge));
+  if(wtb!=(c.edge.to.res==S.gold_id)) error("add_offer(): % offer % has to buy gold iff it is a WTB one",wtb ? "WTB" : "WTS",show(c.edge));
+  c.renumber(S);
+  S.trans.add(c.edge);
+  if(wtb){ S.wtb_offers++; S.zobrist.offer.insert(S.zobrist.offer.begin()+c.edge.offer,S.zobrist.key()); }
+  else S.wts_offers++;
+  S.zobrist.last.insert(S.zobrist.last.begin()+c.edge.offer,S.zobrist.key());
+  S.csr = CSR(S.trans);
+  c.rekey(S);
+  return c;
+}
+
+// Removes the offer o from S.
+static SpecChange remove_offer(Spec &S, OfferID o) {
+  if(o>=S.wtb_offers+S.wts_offers) error("remove_offer(): no offer %",o);
+  auto &C = S.csr;
+  EdgeID e = 0;
+  while(C.offer[e]!=o) e++;
+  SpecChange c{
+    .edge = {
+      .from = {.res = C.from_res[e], .units = C.from_units[e]},
+      .to = {.res = C.to_res[e], .units = C.to_units[e]},
+      .offer = o,
+    },
+    .added = false,
+    .wtb = o<S.wtb_offers,
+  };
+  auto erase = [o](vec<Graph::Edge> &v){ v.erase(std::find_if(v.begin(),v.end(),[o](const Graph::Edge &x){ return x.offer==o; })); };
+  erase(S.trans.nodes[c.edge.from.res].out);
+  erase(S.trans.nodes[c.edge.to.res].in);
+  c.renumber(S);
+  if(c.wtb){ S.wtb_offers--; S.zobrist.offer.erase(S.zobrist.offer.begin()+o); }
+  else S.wts_offers--;
+  S.zobrist.last.erase(S.zobrist.last.begin()+o);
+  S.csr = CSR(S.trans);
+  // No rekeying: every subtree only shrinks, so the transposition table entries
+  // stay exhaustive, unless the removal lowers the best solution (see DFS::warm_start).
+  return c;
+}
+
+
+// Bits is a util::Bitset wide enough for the WTB offers, and R is the capacity
+// of the resources, sized independently, see with_state().
+// The state is stored inline, hot data first: it needs no allocation
+// and a copy of it is a few straight, vectorized loops.
+template<typename Bits, size_t R> struct State {
+  explicit State(const Spec &_S) : S(_S) {}
+
+  util::FixedVec<Units,R> resources_avail;
+  Bits wtb_used;
+  uint64_t hash = 0; // see Zobrist
+  uint32_t wtb_used_count = 0;
+  uint32_t depth = 0;
+  const Spec &S;
+
+  void init_hash() {
+    auto &Z = S.zobrist;
+    hash = 0;
+    for(size_t i=0; i<resources_avail.size(); i++) hash += Z.res[i]*resources_avail[i];
+    for(size_t i=0; i<S.wtb_offers; i++) if(wtb_used.test(i)) hash += Z.offer[i];
+  }
+
+  friend str show(const State &s) {
+    str wtb_used_bits = "";
+    for(size_t i=0; i<s.S.wtb_offers; i++) wtb_used_bits += s.wtb_used.test(i) ? '1' : '0';
+
+    vec<str> res;
+    for(auto x : s.resources_avail) res.push_back(util::to_str(x));
+    return util::fmt("{ depth = %; wtb_used = (%) %; resources = {%} }",s.depth,show(s.wtb_used),wtb_used_bits,util::join(",",res));
+  }
+
+  struct Transaction {
+    State &s;
+    const EdgeID e;
+    const ResourceID from;
+    ResourceID to;
+    Units from_units, to_units;
+    bool ok = 0;
+    
+    Units t;
+    bool is_gold;
+
+    INL operator bool(){ return ok; }
+    // from has to be s.S.csr.from_res[e]; the DFS loop knows it already.
+    INL Transaction(State &_s, ResourceID _from, EdgeID _e) : s(_s), e(_e), from(_from) {
+      PROF_CYCLES("Transaction()");
+      auto &C = s.S.csr;
+      auto got = s.resources_avail[from];
+      from_units = C.from_units[e];
+      if(got<from_units) return;
+      to = C.to_res[e];
+      is_gold = (to==s.S.gold_id);
+      // The amounts almost always fit in 32 bits, where the division is several times faster.
+      t = is_gold ? !s.wtb_used.test(C.offer[e]) : (got|from_units)>>32 ? got/from_units : uint32_t(got)/uint32_t(from_units);
+      if(!t) return;
+
+      ok = 1;
+      to_units = C.to_units[e];
+      auto &Z = s.S.zobrist;
+      if(is_gold) {
+        s.wtb_used.set(C.offer[e]);
+        s.wtb_used_count++;
+        s.hash += Z.offer[C.offer[e]];
+      }
+      s.hash += (Z.res[to]*to_units-Z.res[from]*from_units)*t;
+      s.depth++;
+      s.resources_avail[to] += to_units*t;
+      s.resources_avail[from] -= from_units*t;
+    }
+    INL Transaction(State &_s, EdgeID _e) : Transaction(_s,_s.S.csr.from_res[_e],_e) {}
+    INL ~Transaction() {
+      PROF_CYCLES("~Transaction()");
+      if(!ok) return;
+      auto &Z = s.S.zobrist;
+      if(is_gold) {
+        auto offer = s.S.csr.offer[e];
+        s.wtb_used.reset(offer);
+        s.wtb_used_count--;
+        s.hash -= Z.offer[offer];
+      }
+      s.hash -= (Z.res[to]*to_units-Z.res[from]*from_units)*t;
+      s.depth--;
+      s.resources_avail[to] -= to_units*t;
+      s.resources_avail[from] += from_units*t; 
+    }
+  };
+};
+
+// Calls f(Bits(),std::integral_constant<size_t,R>()) with the smallest Bits and R
+// of a State which fit the given numbers of WTB offers and resources.
+template<typename F> inline auto with_state(size_t wtb_offers, size_t resources, F f) {
+  return util::with_bitset(wtb_offers,[&](auto bits) {
+    return util::with_capacity(resources,[&](auto cap){ return f(bits,cap); });
+  });
+}
+
+// Admissible upper bound on the number of WTB offers which can still be filled,
+// used for branch-and-bound.
+// cost[r] is the lowest price of a unit of r in gold, via the non-WTB offers.
+// Measured in cost, the wealth W = sum_r cost[r]*resources_avail[r] never grows
+// by a non-WTB transaction, while filling a WTB offer o changes it by -net[o],
+// where net[o] = cost of the units it takes - gold it gives.
+// W stays nonnegative, so a set of offers can be filled only if the sum of
+// their net is at most W. The largest such set consists of the offers with
+// the smallest net, which is what operator() counts.
+struct Bound {
+  Bound(const Spec &S) : cost(S.names.size(),inf) {
+    cost[S.gold_id] = 1;
+    relax(S);
+    index(S);
+  }
+
+  // Updates the bound after the change c of S. Adding an offer can only lower
+  // the costs, so the relaxation continues from the current ones. So does removing
+  // an offer which does not determine any cost, otherwise they are recomputed.
+  void update(const Spec &S, const SpecChange &c) {
+    cost.resize(S.names.size(),inf);
+    auto &e = c.edge;
+    bool tight = !c.wtb && cost[e.from.res]!=inf && cost[e.to.res]>=cost[e.from.res]*e.from.units/e.to.units*(1-eps);
+    if(!enabled || (!c.added && tight)) {
+      std::fill(cost.begin(),cost.end(),inf);
+      cost[S.gold_id] = 1;
+      enabled = true;
+    }
+    relax(S);
+    index(S);
+  }
+  // False if the book has an arbitrage cycle among the non-WTB offers.
+  // Then the bound is the trivial one, the number of all the WTB offers.
+  bool enabled = true;
+  vec<double> cost;
+  vec<std::pair<double,OfferID>> by_net; // sorted by net
+
+  // Returns an upper bound on the number of WTB offers which can be filled from s.
+  template<typename State> size_t operator()(const State &s) const {
+    if(!enabled) return s.S.wtb_offers;
+    double W = 0;
+    for(size_t r=0; r<s.resources_avail.size(); r++) {
+      if(!s.resources_avail[r]) continue;
+      // r cannot be bought, so wealth cannot be measured.
+      if(cost[r]==inf) return s.S.wtb_offers;
+      W += cost[r]*s.resources_avail[r];
+    }
+    W = W*(1+eps)+eps;
+    size_t n = 0;
+    for(auto [net,o] : by_net) {
+      if(s.wtb_used.test(o)) continue;
+      if(net>W) break;
+      W -= net;
+      n++;
+    }
+    return n;
+  }
+private:
+  static constexpr double inf = std::numeric_limits<double>::infinity();
+  // Slack against the rounding errors, to keep the bound admissible.
+  static constexpr double eps = 1e-9;
+
+  void relax(const Spec &S) {
+    auto &C = S.csr;
+    // Bellman-Ford; edges into gold are the WTB offers.
+    bool changed = true;
+    for(size_t it=0; changed && it<=C.nodes(); it++) {
+      changed = false;
+      for(EdgeID e=0; e<C.edges(); e++) {
+        if(C.to_res[e]==S.gold_id || cost[C.from_res[e]]==inf) continue;
+        double c = cost[C.from_res[e]]*C.from_units[e]/C.to_units[e];
+        if(c<cost[C.to_res[e]]*(1-eps)){ cost[C.to_res[e]] = c; changed = true; }
+      }
+    }
+    // Arbitrage among the non-WTB offers: wealth is not bounded.
+    if(changed){ info("Bound: arbitrage cycle detected, bound disabled"); enabled = false; }
+  }
+
+  void index(const Spec &S) {
+    auto &C = S.csr;
+    by_net.clear();
+    if(!enabled) return;
+    for(EdgeID e=0; e<C.edges(); e++) {
+      if(C.to_res[e]!=S.gold_id || cost[C.from_res[e]]==inf) continue;
+      by_net.push_back({C.from_units[e]*cost[C.from_res[e]]-C.to_units[e],C.offer[e]});
+    }
+    std::sort(by_net.begin(),by_net.end());
+  }
+};
+
+// LP relaxation of the search, as a generalized flow:
+// x[e] >= 0 is the (fractional) number of times edge e is taken,
+//   sum_{e out of r} from_units[e]*x[e] - sum_{e into r} to_units[e]*x[e] <= resources_avail[r]
+// for every resource r, x[e] <= 1 for the unused WTB offers, x[e] = 0 for the used ones,
+// and the objective is the number of WTB offers filled, sum of x[e] over them.
+// The totals of any sequence of transactions are feasible, so the optimum is an
+// upper bound on the offers which can still be filled, and the optimal x is
+// a fractional plan.
+struct FlowBound {
+  // Dense tableau of size (resources+WTB offers) x edges above this is not worth it.
+  static constexpr size_t max_size = 1<<22;
+
+  FlowBound(const Spec &S) : C(S.csr), gold_id(S.gold_id) {
+    for(EdgeID e=0; e<C.edges(); e++) if(C.to_res[e]==gold_id) wtb.push_back(e);
+    m = C.nodes()+wtb.size();
+    n = C.edges();
+    if(m*n>max_size){ info("FlowBound: % x % LP is too big, disabled",m,n); enabled = false; return; }
+    A.assign(m*n,0);
+    for(EdgeID e=0; e<n; e++) {
+      A[C.from_res[e]*n+e] += C.from_units[e];
+      A[C.to_res[e]*n+e] -= C.to_units[e];
+    }
+    c.assign(n,0);
+    for(size_t k=0; k<wtb.size(); k++){ A[(C.nodes()+k)*n+wtb[k]] = 1; c[wtb[k]] = 1; }
+  }
+
+  bool enabled = true;
+
+  // Returns an upper bound on the number of WTB offers which can be filled from s.
+  // plan is set to the edges of the fractional plan, the most used first.
+  template<typename State> size_t solve(const State &s, Path &plan) const {
+    vec<double> b(m);
+    for(size_t r=0; r<C.nodes(); r++) b[r] = s.resources_avail[r];
+    for(size_t k=0; k<wtb.size(); k++) b[C.nodes()+k] = !s.wtb_used.test(C.offer[wtb[k]]);
+    util::Simplex LP(m,n,A,b,c);
+    plan.clear();
+    // The objective is bounded by the number of WTB offers.
+    if(LP.solve()!=util::Simplex::OPTIMAL) return wtb.size();
+    for(EdgeID e=0; e<n; e++) if(LP.x[e]>eps) plan.push_back(e);
+    std::sort(plan.begin(),plan.end(),[&](EdgeID a, EdgeID b){ return LP.x[a]>LP.x[b]; });
+    return size_t(LP.value+eps);
+  }
+
+private:
+  static constexpr double eps = 1e-6;
+  const CSR &C;
+  ResourceID gold_id;
+  vec<EdgeID> wtb;
+  size_t m,n;
+  vec<double> A,c;
+};
+
+// State-independent move ordering of DFS: the edges into gold (the WTB offers)
+// first, the edges from gold last, and the others by the gain
+// to_units*value[to]-from_units*value[from], where value[r] is the CSR::dij()
+// distance of r from gold: the smallest product of the from_units along a chain
+// of offers from gold to r (0 if there is none). It ignores the to_units, so
+// it is not a price, only a cheap proxy for the value of a unit of r.
+struct EdgeOrder {
+  EdgeOrder(const Spec &S) {
+    auto &C = S.csr;
+    auto D = C.dij(S.gold_id);
+    vec<double> gain(C.edges());
+    for(EdgeID e=0; e<C.edges(); e++) gain[e] = double(C.to_units[e])*D[C.to_res[e]].dist-double(C.from_units[e])*D[C.from_res[e]].dist;
+    vec<EdgeID> E(C.edges());
+    for(EdgeID e=0; e<C.edges(); e++) E[e] = e;
+    auto wtb = [&](EdgeID e){ return C.to_res[e]==S.gold_id; };
+    auto gold = [&](EdgeID e){ return C.from_res[e]==S.gold_id; };
+    std::stable_sort(E.begin(),E.end(),[&](EdgeID a, EdgeID b) {
+      if(wtb(a)!=wtb(b)) return wtb(a);
+      if(gold(a)!=gold(b)) return gold(b);
+      return gain[a]>gain[b];
+    });
+    rank.resize(C.edges());
+    for(size_t i=0; i<E.size(); i++) rank[E[i]] = i;
+    edges = E;
+  }
+  vec<EdgeID> edges; // in the order
+  vec<uint32_t> rank; // position of the edge in the order
+};
+
+// Fixed-size, lock-free transposition table.
+// For every visited state it records the depth at which its subtree has been
+// fully explored, the draft (depth bound - depth) of that exploration,
+// and the best wtb_used_count reachable from it.
+// Since the pruning rule of DFS only gets stricter with depth, revisiting
+// a state at the same or bigger depth with the same or smaller draft can be cut off.
+// Entries are stored as (hash^data,data) pairs, so that a torn concurrent
+// write is detected as a key mismatch (Hyatt's lockless hashing).
+// Data also holds the generation of the entry; clear() starts a new one,
+// so that a table can be reused by unrelated searches without wiping it.
+struct TransTable {
+  struct Entry {
+    std::atomic<uint64_t> key{0};
+    std::atomic<uint64_t> data{0};
+  };
+  struct alignas(64) Bucket { Entry e[4]; };
+
+  TransTable(size_t bytes) {
+    size_t n = 1;
+    while(2*n*sizeof(Bucket)<=bytes) n *= 2;
+    buckets = vec<Bucket>(n);
+    mask = n-1;
+  }
+
+  // Returns true iff hash has been found.
+  bool probe(uint64_t hash, size_t &depth, size_t &draft, size_t &best) const {
+    for(auto &e : buckets[hash&mask].e) {
+      auto d = e.data.load(std::memory_order_relaxed);
+      if(!d || (d>>48&gen_mask)!=gen || (e.key.load(std::memory_order_relaxed)^d)!=hash) continue;
+      draft = uint16_t(d>>32);
+      depth = uint16_t(d>>16);
+      best = uint16_t(d);
+      return true;
+    }
+    return false;
+  }
+
+  // An entry for the same state is overwritten unless it covers the new one,
+  // otherwise the entry of the bucket with the smallest subtree
+  // (the biggest depth-draft) is evicted, unless the new one is even smaller.
+  void store(uint64_t hash, size_t depth, size_t draft, size_t best) {
+    uint64_t d = 1ull<<63 | gen<<48 | uint64_t(uint16_t(draft))<<32 | uint64_t(uint16_t(depth))<<16 | uint16_t(best);
+    auto size = [](size_t depth, size_t draft){ return (1<<16)+depth-draft; };
+    Entry *victim = 0;
+    size_t victim_size = 0;
+    for(auto &e : buckets[hash&mask].e) {
+      auto ed = e.data.load(std::memory_order_relaxed);
+      // Entries are never emptied, so the rest of the bucket is empty too.
+      if(!ed){ if(victim_size!=size_t(-1)) victim = &e; victim_size = size_t(-1); break; }
+      // Entries of the previous generations are free.
+      if((ed>>48&gen_mask)!=gen){ if(victim_size!=size_t(-1)) victim = &e; victim_size = size_t(-1); continue; }
+      size_t edepth = uint16_t(ed>>16), edraft = uint16_t(ed>>32);
+      if((e.key.load(std::memory_order_relaxed)^ed)==hash) {
+        // The stored entry covers a strict superset of the subtree.
+        if(edepth<=depth && edraft>=draft && (edepth<depth || edraft>draft)) return;
+        victim = &e; victim_size = size_t(-1);
+        break;
+      }
+      if(!victim || size(edepth,edraft)>victim_size){ victim = &e; victim_size = size(edepth,edraft); }
+    }
+    if(victim_size<size(depth,draft)) return;
+    victim->data.store(d,std::memory_order_relaxed);
+    victim->key.store(hash^d,std::memory_order_relaxed);
+  }
+
+  // Drops all the entries, in O(1) except once per gen_mask+1 calls.
+  // Not safe to call during a search.
+  void clear() {
+    if(++gen<=gen_mask) return;
+    gen = 0;
+    for(auto &b : buckets) for(auto &e : b.e){ e.key.store(0,std::memory_order_relaxed); e.data.store(0,std::memory_order_relaxed); }
+  }
+
+private:
+  static constexpr uint64_t gen_mask = (1<<15)-1;
+  vec<Bucket> buckets;
+  uint64_t mask;
+  uint64_t gen = 0;
+};
+
+// Explored states, for the dominance pruning: a state with the same wtb_used
+// and at most the resources of an explored state, not shallower and with
+// no more depth left, is not searched again.
+// It is a heuristic: a transaction converts as many units as it can, so more
+// of a resource may leave a smaller remainder, and filling the same offers
+// from the bigger state may take a different, possibly longer, sequence.
+// Entries are searched in buckets of 4 by wtb_used and are evicted like
+// the ones of TransTable. Not thread-safe: every worker owns one.
+template<typename Bits, size_t R> struct DominanceTable {
+  DominanceTable(size_t entries, size_t _resources) : resources(_resources) {
+    size_t n = 1;
+    while(2*n*bucket_size<=entries) n *= 2;
+    mask = n-1;
+    wtb_used.resize(n*bucket_size);
+    meta.resize(n*bucket_size);
+    units.resize(n*bucket_size*resources);
+  }
+
+  bool dominated(const State<Bits,R> &s, size_t draft) const {
+    size_t b = bucket(s.wtb_used);
+    for(size_t i=b; i<b+bucket_size; i++) {
+      auto &m = meta[i];
+      if(m.draft<draft || m.depth>s.depth || wtb_used[i]!=s.wtb_used) continue;
+      if(covers(&units[i*resources],&s.resources_avail[0])) return true;
+    }
+    return false;
+  }
+
+  // Overwrites an entry which the new one dominates, otherwise
+  // the entry of the bucket with the smallest subtree.
+  void store(const State<Bits,R> &s, size_t draft) {
+    size_t b = bucket(s.wtb_used);
+    size_t victim = b;
+    for(size_t i=b; i<b+bucket_size; i++) {
+      auto &m = meta[i];
+      if(!m.draft){ victim = i; break; }
+      if(m.draft<=draft && m.depth>=s.depth && wtb_used[i]==s.wtb_used && covers(&s.resources_avail[0],&units[i*resources])){ victim = i; break; }
+      if(size(m)<size(meta[victim])) victim = i;
+    }
+    wtb_used[victim] = s.wtb_used;
+    meta[victim] = {uint32_t(s.depth),uint32_t(draft)};
+    std::copy(&s.resources_avail[0],&s.resources_avail[0]+resources,&units[victim*resources]);
+  }
+
+private:
+  static constexpr size_t bucket_size = 4;
+  struct Meta { uint32_t depth = 0, draft = 0; }; // draft = 0: empty
+  size_t resources;
+  size_t mask;
+  vec<Bits> wtb_used;
+  vec<Meta> meta;
+  vec<Units> units; // resources per entry
+
+  static int64_t size(const Meta &m){ return int64_t(m.draft)-m.depth; }
+  size_t bucket(const Bits &b) const {
+    uint64_t h = 0;
+    for(size_t k=0; k<Bits::words; k++) h = (h^b.w[k])*0x9e3779b97f4a7c15ull;
+    return (h>>32&mask)*bucket_size;
+  }
+  // True iff a>=b, componentwise.
+  bool covers(const Units *a, const Units *b) const {
+    bool less = false;
+    for(size_t i=0; i<resources; i++) less |= a[i]<b[i];
+    return !less;
+  }
+};
+
+// Sequence of transactions leading to a solution, with the inventory after each of them.
+struct Plan {
+  struct Step {
+    OfferID offer;
+    ResourceID from, to;
+    Units from_units, to_units; // total, i.e. multiplied by t
+    Units t; // multiplicity
+    vec<Units> inventory;
+  };
+  vec<Units> inventory; // starting one
+  vec<Step> steps;
+  size_t wtb_used_count = 0;
+
+  // Replays path from the root state s.
+  template<typename State> static Plan trace(State s, const Path &path) {
+    Plan p;
+    p.inventory = s.resources_avail;
+    trace(s,path,0,p);
+    return p;
+  }
+
+  str show_json(const Spec &S) const {
+    auto quote = [](std::string_view x) {
+      str q = "\"";
+      for(char c : x) {
+        if(c=='"' || c=='\\') q += '\\';
+        if(uint8_t(c)<0x20){ char buf[8]; snprintf(buf,sizeof buf,"\\u%04x",c); q += buf; continue; }
+        q += c;
+      }
+      return q + "\"";
+    };
+    auto units = [](const vec<Units> &v) {
+      vec<str> x;
+      for(auto u : v) x.push_back(util::to_str(u));
+      return "[" + util::join(",",x) + "]";
+    };
+    vec<str> names,steps_json;
+    for(size_t i=0; i<S.names.size(); i++) names.push_back(quote(S.names.lookup_name(i)));
+    for(auto &st : steps) steps_json.push_back(util::fmt(
+      "{\"offer\":%,\"t\":%,\"from\":{\"res\":%,\"units\":%},\"to\":{\"res\":%,\"units\":%},\"inventory\":%}",
+      st.offer,st.t,st.from,st.from_units,st.to,st.to_units,units(st.inventory)));
+    return util::fmt("{\"resources\":[%],\"wtb_used_count\":%,\"inventory\":%,\"steps\":[\n%\n]}\n",
+      util::join(",",names),wtb_used_count,units(inventory),util::join(",\n",steps_json));
+  }
+
+  friend str show(const Plan &p) {
+    vec<str> steps;
+    for(auto &st : p.steps) steps.push_back(util::fmt("%x (%x [%]) -%> (%x [%])",st.t,st.from_units,st.from,st.offer,st.to_units,st.to));
+    return util::fmt("{ wtb_used_count = %; steps = [%] }",p.wtb_used_count,util::join(", ",steps));
+  }
+
+private:
+  template<typename State> static void trace(State &s, const Path &path, size_t i, Plan &p) {
+    if(i==path.size()){ p.wtb_used_count = s.wtb_used_count; return; }
+    typename State::Transaction T(s,path[i]);
+    if(!T) error("Plan::trace(): transaction % not applicable",s.S.csr.show_edge(path[i]));
+    p.steps.push_back({
+      .offer = s.S.csr.offer[path[i]],
+      .from = T.from,
+      .to = T.to,
+      .from_units = T.from_units*T.t,
+      .to_units = T.to_units*T.t,
+      .t = T.t,
+      .inventory = s.resources_avail,
+    });
+    trace(s,path,i+1,p);
+  }
+};
+
+// Task pool of the parallel DFS. A task is the path of edges from the root.
+struct WorkPool {
+  // Tasks are spawned only this close to the root, so that they are
+  // large enough to amortize the replay of the path.
+  static constexpr size_t split_depth = 12;
+
+  struct Worker {
+    std::mutex mtx;
+    std::deque<Path> tasks;
+  };
+  WorkPool(size_t n) : workers(n) {}
+  vec<Worker> workers;
+  std::atomic<size_t> pending{0}; // queued or running tasks
+  std::atomic<size_t> queued{0};
+  std::atomic<size_t> idle{0};
+
+  void push(size_t w, Path task) {
+    pending++;
+    queued++;
+    std::lock_guard<std::mutex> L(workers[w].mtx);
+    workers[w].tasks.push_back(std::move(task));
+  }
+
+  // Pops the newest task of worker w (depth-first order),
+  // otherwise steals the oldest (largest) task of another worker.
+  bool pop(size_t w, Path &task) {
+    for(size_t i=0; i<workers.size(); i++) {
+      auto &W = workers[(w+i)%workers.size()];
+      std::lock_guard<std::mutex> L(W.mtx);
+      if(W.tasks.empty()) continue;
+      if(i==0){ task = std::move(W.tasks.back()); W.tasks.pop_back(); }
+      else { task = std::move(W.tasks.front()); W.tasks.pop_front(); }
+      queued--;
+      return true;
+    }
+    return false;
+  }
+};
+
+// Pareto front of the solutions over (WTB offers filled, gold left, transactions),
+// the first two maximized and the last minimized, shared by the workers of a search.
+// The points are indexed by the offers filled: per count, a staircase sorted by
+// the transactions, with strictly increasing gold. A point (c,g,d) is dominated iff
+// for some c' >= c the last point of the staircase c' with at most d transactions
+// has at least g gold, which is found by a binary search.
+// A subtree is pruned iff the front dominates the best point it may contain:
+// b more offers filled (see Bound), the payments of all the open offers,
+// and a transaction more.
+struct ParetoFront {
+  struct Point {
+    size_t count;
+    Units gold;
+    size_t depth;
+    Path path;
+  };
+
+  explicit ParetoFront(const Spec &S) : gold_id(S.gold_id), wtb_offers(S.wtb_offers), pay(S.wtb_offers,0), stairs(S.wtb_offers+1) {
+    auto &C = S.csr;
+    for(EdgeID e=0; e<C.edges(); e++) if(C.offer[e]<S.wtb_offers) pay[C.offer[e]] = C.to_units[e];
+    for(auto o : S.filled) pay[o] = 0;
+    for(auto p : pay) pay_total += p;
+  }
+
+  // Adds the solution s, reached by path, unless it is dominated.
+  template<typename Bits, size_t R> void insert(const ::State<Bits,R> &s, const Path &path) {
+    Units g = s.resources_avail[gold_id];
+    std::lock_guard<std::mutex> L(mtx);
+    if(find(s.wtb_used_count,g,s.depth)) return;
+    // The points dominated by the new one: a range of every staircase up to its count.
+    for(size_t c=0; c<=s.wtb_used_count; c++) {
+      auto &st = stairs[c];
+      auto i = first_depth(st,s.depth);
+      auto j = i;
+      while(j<st.size() && st[j].gold<=g) j++;
+      st.erase(st.begin()+i,st.begin()+j);
+    }
+    auto &st = stairs[s.wtb_used_count];
+    st.insert(st.begin()+first_depth(st,s.depth),Point{s.wtb_used_count,g,s.depth,path});
+    max_count = std::max<size_t>(max_count,s.wtb_used_count);
+  }
+
+  // Checks whether the front dominates every solution in the subtree of s,
+  // in which at most b more offers can be filled.
+  template<typename Bits, size_t R> bool dominated(const ::State<Bits,R> &s, size_t b) const {
+    Units paid = 0;
+    for(size_t k=0; k<Bits::words; k++) for(uint64_t x = s.wtb_used.w[k]; x; x &= x-1) {
+      size_t o = 64*k+__builtin_ctzll(x);
+      if(o<wtb_offers) paid += pay[o];
+    }
+    // Gold is gained only by filling offers.
+    Units g = s.resources_avail[gold_id]+(b ? pay_total-paid : 0);
+    std::lock_guard<std::mutex> L(mtx);
+    return find(s.wtb_used_count+b,g,s.depth+1);
+  }
+
+  // The points, by the offers filled, then by the gold, from the most.
+  vec<Point> points() const {
+    std::lock_guard<std::mutex> L(mtx);
+    vec<Point> v;
+    for(size_t c=stairs.size(); c--;) for(size_t i=stairs[c].size(); i--;) v.push_back(stairs[c][i]);
+    return v;
+  }
+
+private:
+  ResourceID gold_id;
+  size_t wtb_offers;
+  vec<Units> pay; // per WTB offer, 0 if filled already
+  Units pay_total = 0;
+  mutable std::mutex mtx;
+  vec<vec<Point>> stairs; // by the offers filled
+  size_t max_count = 0;
+
+  // Index of the first point with at least d transactions.
+  static size_t first_depth(const vec<Point> &st, size_t d) {
+    return std::lower_bound(st.begin(),st.end(),d,[](const Point &p, size_t d){ return p.depth<d; })-st.begin();
+  }
+
+  bool find(size_t c, Units g, size_t d) const {
+    for(; c<=max_count; c++) {
+      auto &st = stairs[c];
+      auto i = first_depth(st,d+1);
+      if(i && st[i-1].gold>=g) return true;
+    }
+    return false;
+  }
+};
+
+template<typename Bits, size_t R> struct DFS {
+  using State = ::State<Bits,R>;
+  // Best solution found so far, shared by all the workers of a search.
+  struct Result {
+    std::atomic<size_t> best{0};
+    std::mutex mtx;
+    Bits wtb_used;
+    Path path;
+    std::atomic<bool> stopped{false}; // the search has been interrupted by ctx
+    std::atomic<size_t> nodes{0}; // visited by the finished searches
+    double first_time = 0, best_time = 0; // realtime_sec() of the first and the last improvement
+    bool verbose = true; // log the improvements
+
+    void improve(const State &s, const Path &_path) {
+      std::lock_guard<std::mutex> L(mtx);
+      if(s.wtb_used_count<=best.load(std::memory_order_relaxed)) return;
+      wtb_used = s.wtb_used;
+      path = _path;
+      best_time = realtime_sec();
+      if(!first_time) first_time = best_time;
+      best.store(s.wtb_used_count,std::memory_order_release);
+      if(verbose) info("% % transactions done %",show(s.wtb_used),s.wtb_used_count,show(s));
+    }
+  };
+
+  // The search stops when _ctx is done; the best solution found so far is kept.
+  DFS(const Spec &_S, size_t _depth_limit, Ctx::Ptr _ctx = 0) : DFS(_S,_S.inventory,_depth_limit,_ctx) {}
+  // Search from the given starting inventory instead of the one of the Spec.
+  DFS(const Spec &_S, const vec<Units> &inventory, size_t _depth_limit, Ctx::Ptr _ctx = 0) : state{_S}, depth_limit(_depth_limit), depth_bound(_depth_limit), ctx(_ctx) {
+    if(inventory.size()!=_S.names.size()) error("DFS: inventory of % resources, want %",inventory.size(),_S.names.size());
+    state.resources_avail = inventory;
+    for(auto o : _S.filled) state.wtb_used.set(o);
+    state.init_hash();
+    path.reserve(depth_limit);
+  }
+  State state;
+  
+  size_t depth_limit = 0;
+  size_t depth_bound = 0; // current iteration's depth limit, see deepen()
+  std::shared_ptr<Result> result = std::make_shared<Result>();
+  std::shared_ptr<TransTable> tt; // optional
+  // If set, the search is exact up to depth_bound and prunes subtrees by the bound,
+  // instead of by the heuristic depth rule.
+  std::shared_ptr<const Bound> bound;
+  // If set, nodes shallower than lp_depth are also bounded by the LP relaxation,
+  // and the edges of its fractional plan are searched first.
+  std::shared_ptr<const FlowBound> lp;
+  size_t lp_depth = 0;
+  // If set, the children of a node are searched in this order, refined by the
+  // history and killer heuristics if use_history, instead of by resource and offer ID.
+  std::shared_ptr<const EdgeOrder> order;
+  bool use_history = true;
+  // Partial order reduction. Two transactions on disjoint resources commute:
+  // they are applicable in either order and lead to the same state. If set,
+  // of two consecutive commuting transactions only the canonical order
+  // (see por_key()) is searched. It is exact, since every sequence can be
+  // sorted into one without such inverted pairs.
+  bool por = false;
+  // Number of entries of the per worker DominanceTable, 0 = no dominance pruning.
+  size_t dominance = 0;
+  // If set, every solution is offered to the front and the subtrees are pruned
+  // against it, instead of against the best count and by the heuristic depth rule.
+  std::shared_ptr<ParetoFront> front;
+  size_t best() const { return result->best; }
+  // Best solution found so far. Call between searches only, state has to be the root.
+  Plan plan() const {
+    std::lock_guard<std::mutex> L(result->mtx);
+    return Plan::trace(state,result->path);
+  }
+  // Seeds the search with prev, the best plan before the change c of the Spec:
+  // its offers are replayed in order, skipping the removed one and those which
+  // do not apply anymore, the best prefix becomes the initial solution, and
+  // the replayed line is searched first.
+  // Call before the search. Returns the wtb_used_count of the seeded solution.
+  // If it is lower than prev.wtb_used_count, the transposition table has to be cleared:
+  // its entries cut off subtrees without recording their solutions, which were
+  // not better than the previous best, but may be better than the seeded one.
+  // Otherwise it stays valid with por too: its keys and the transactions it
+  // skips depend on the OfferIDs only through Zobrist::last and their relative
+  // order, both of which the change preserves.
+  size_t warm_start(const Plan &prev, const SpecChange &c) {
+    auto &C = state.S.csr;
+    vec<EdgeID> edge_of(state.S.wtb_offers+state.S.wts_offers);
+    for(EdgeID e=0; e<C.edges(); e++) edge_of[C.offer[e]] = e;
+    Path line;
+    for(auto &st : prev.steps) {
+      auto o = c.remap(st.offer);
+      if(o!=SpecChange::NONE) line.push_back(edge_of[o]);
+    }
+    pv.clear();
+    seed(line,0);
+    return best();
+  }
+  bool stopped() const { return result->stopped; }
+  size_t nodes_visited() const { return result->nodes; }
+  
+  // Returns the best wtb_used_count found in the subtree.
+  size_t run() {
+    //info("state = %",show(state));
+    size_t sub_best = state.wtb_used_count;
+    if(sub_best>result->best.load(std::memory_order_relaxed)) result->improve(state,path);
+    if(front){ PROF_CYCLES("ParetoFront::insert"); front->insert(state,path); }
+    nodes++;
+    PROF_HIST("visited",state.depth);
+    if(ctx && !(nodes&poll_mask)) poll();
+    if(stop) return sub_best;
+    if(state.depth>=depth_bound){ PROF_HIST("pruned by depth_bound",state.depth); return sub_best; }
+    // Whether the subtree cannot improve the solutions found, if at most b more offers can be filled in it.
+    auto pruned = [&](size_t b) {
+      if(!front) return state.wtb_used_count+b<=result->best.load(std::memory_order_relaxed);
+      PROF_CYCLES("ParetoFront::dominated");
+      return front->dominated(state,b);
+    };
+    if(bound) {
+      size_t b;
+      { PROF_CYCLES("Bound"); b = (*bound)(state); }
+      if(pruned(b)){ PROF_HIST("pruned by bound",state.depth); return sub_best; }
+    } else if(front) {
+      if(pruned(state.S.wtb_offers-state.wtb_used.count())){ PROF_HIST("pruned by front",state.depth); return sub_best; }
+    } else if(state.depth>state.wtb_used_count*4+7){ PROF_HIST("pruned by depth rule",state.depth); return sub_best; }
+    size_t draft = depth_bound-state.depth;
+    // The subtree searched under partial order reduction depends on the last
+    // transaction too, so it is a part of the key, by its offer, see warm_start().
+    uint64_t tt_key = state.hash;
+    if(por && path.size()) tt_key ^= state.S.zobrist.last[state.S.csr.offer[path.back()]];
+    if(tt) {
+      size_t tt_depth,tt_draft,tt_best;
+      bool hit;
+      { PROF_CYCLES("TransTable::probe"); hit = tt->probe(tt_key,tt_depth,tt_draft,tt_best); }
+      if(hit && tt_depth<=state.depth && tt_draft>=draft){ PROF_HIST("pruned by tt",state.depth); return tt_best; }
+    }
+    if(dominance) {
+      if(!dom) dom = std::make_shared<DominanceTable<Bits,R>>(dominance,state.resources_avail.size());
+      bool hit;
+      { PROF_CYCLES("DominanceTable::dominated"); hit = dom->dominated(state,draft); }
+      if(hit){ PROF_HIST("pruned by dominance",state.depth); return sub_best; }
+    }
+    Path *lp_plan = 0;
+    if(lp && state.depth<lp_depth) {
+      if(lp_plans.size()<lp_depth) lp_plans.resize(lp_depth);
+      lp_plan = &lp_plans[state.depth];
+      size_t b;
+      { PROF_CYCLES("FlowBound"); b = lp->solve(state,*lp_plan); }
+      if(pruned(b)){ PROF_HIST("pruned by lp",state.depth); return sub_best; }
+    }
+    bool split = pool && should_split();
+    auto &C = state.S.csr;
+    size_t depth = state.depth;
+    if(order && move_bufs.size()<depth_limit) {
+      move_bufs.resize(depth_limit);
+      killers.assign(depth_limit,EdgeID(-1));
+      history.assign(C.edges(),0);
+    }
+    bool learn = order && use_history;
+    // The transactions which commute with the last one and precede it in the canonical order
+    // are skipped. last_key = 0 skips none.
+    uint64_t last_key = 0;
+    ResourceID last_from = 0, last_to = 0;
+    if(por && path.size()){ auto l = path.back(); last_key = por_key(l); last_from = C.from_res[l]; last_to = C.to_res[l]; }
+    auto commutes_back = [&](EdgeID e) INLL {
+      if(por_key(e)>=last_key) return false;
+      ResourceID a = C.from_res[e], b = C.to_res[e];
+      return a!=last_from && a!=last_to && b!=last_from && b!=last_to;
+    };
+    auto visit = [&](ResourceID i, EdgeID e) INLL {
+      if(commutes_back(e)) return;
+      typename State::Transaction T(state,i,e);
+      if(!T) return;
+      //info("%",C.show_edge(e));
+      path.push_back(e);
+      if(split) spawn();
+      else if(auto b = run(); b>sub_best) {
+        sub_best = b;
+        if(learn){ history[e] += draft*draft; killers[depth] = e; }
+      }
+      path.pop_back();
+    };
+    // The best line of the previous iteration is searched first.
+    EdgeID pv_edge = EdgeID(-1);
+    if(on_pv) {
+      if(state.depth<pv.size()){ pv_edge = pv[state.depth]; visit(C.from_res[pv_edge],pv_edge); }
+      on_pv = false;
+    }
+    if(lp_plan) {
+      for(auto e : *lp_plan) if(e!=pv_edge) visit(C.from_res[e],e);
+    }
+    // The last move which improved the best of a subtree at this depth.
+    EdgeID killer = EdgeID(-1);
+    if(learn && (killer = killers[depth])!=EdgeID(-1)) {
+      if(killer==pv_edge || (lp_plan && std::find(lp_plan->begin(),lp_plan->end(),killer)!=lp_plan->end())) killer = EdgeID(-1);
+      else visit(C.from_res[killer],killer);
+    }
+    auto visited = [&](EdgeID e) {
+      return e==pv_edge || e==killer || (lp_plan && std::find(lp_plan->begin(),lp_plan->end(),e)!=lp_plan->end());
+    };
+    if(!order) {
+      for(size_t i=state.resources_avail.size();i--;) {
+        auto got = state.resources_avail[i];
+        if(got==0) continue;
+        for(EdgeID e=C.begin[i]; e<C.begin[i+1]; e++) if(!visited(e)) visit(i,e);
+      }
+    } else {
+      // Sort keys: WTB first, then by history, then by the static order.
+      // The buffers of the moves are kept per depth, so they are allocated only while they grow.
+      auto &moves = move_bufs[depth];
+      moves.clear();
+      for(size_t i=0; i<state.resources_avail.size(); i++) {
+        auto got = state.resources_avail[i];
+        if(got==0) continue;
+        for(EdgeID e=C.begin[i]; e<C.begin[i+1]; e++) {
+          if(got<C.from_units[e] || visited(e) || commutes_back(e)) continue;
+          bool wtb = C.to_res[e]==state.S.gold_id;
+          if(wtb && state.wtb_used.test(C.offer[e])) continue;
+          uint64_t h = learn ? std::min<uint64_t>(history[e],(1u<<31)-1) : 0;
+          moves.push_back(uint64_t(wtb)<<63 | h<<32 | ~order->rank[e]);
+        }
+      }
+      std::sort(moves.begin(),moves.end(),std::greater<uint64_t>());
+      for(auto m : moves) {
+        EdgeID e = order->edges[uint32_t(~m)];
+        visit(C.from_res[e],e);
+      }
+    }
+    // A split subtree is explored by other tasks, so it is not complete here.
+    // Neither is an interrupted one.
+    if(tt && !split && !stop){ PROF_CYCLES("TransTable::store"); tt->store(tt_key,state.depth,draft,sub_best); }
+    if(dom && !split && !stop){ PROF_CYCLES("DominanceTable::store"); dom->store(state,draft); }
+    return sub_best;
+  }
+
+  // Iterative deepening: runs the search with depth_bound = step, 2*step, ...
+  // up to depth_limit, so that the best line found so far is reported early.
+  // Every iteration searches the best line of the previous one first
+  // and reuses its transposition table entries.
+  void deepen(size_t threads, size_t step) {
+    for(depth_bound=std::min(step,depth_limit);; depth_bound=std::min(depth_bound+step,depth_limit)) {
+      pv = result->path;
+      run(threads);
+      if(stopped()) break;
+      info("depth_bound = %: best = %, plan = %",depth_bound,best(),show(plan()));
+      if(depth_bound==depth_limit) break;
+    }
+  }
+
+  // Runs the search on the given number of threads.
+  // Every worker owns a copy of the state. The tree is split lazily:
+  // a worker at a shallow node which notices an idle worker turns
+  // the children of that node into tasks, which the idle workers steal.
+  void run(size_t threads) {
+    if(threads<=1){ on_pv = true; run(); result->nodes += nodes; nodes = 0; return; }
+    WorkPool P(threads);
+    vec<DFS> workers(threads,*this);
+    for(size_t i=0; i<threads; i++){ workers[i].pool = &P; workers[i].worker_id = i; workers[i].dom = 0; }
+    P.push(0,{});
+    vec<std::thread> T;
+    for(auto &w : workers) T.emplace_back([&w]{ w.work(); });
+    for(auto &t : T) t.join();
+  }
+
+private:
+  WorkPool *pool = 0;
+  size_t worker_id = 0;
+  Path path;
+  Path pv; // best line of the previous iteration
+  vec<Path> lp_plans; // fractional plan of the LP relaxation, per depth
+  vec<vec<uint64_t>> move_bufs; // sort keys of the moves, per depth
+  vec<EdgeID> killers; // per depth
+  vec<uint64_t> history; // per edge, sum of draft^2 over the nodes at which it improved the best of the subtree
+  std::shared_ptr<DominanceTable<Bits,R>> dom; // allocated by run(), if dominance; not shared by the workers
+  bool on_pv = false; // state is on pv
+
+  // Order of the commuting transactions searched by por: by OfferID, whose relative
+  // order survives the changes of the Spec. The WTB offers come first, so that
+  // the canonical order never has fewer offers filled at the intermediate state
+  // and the heuristic depth rule does not prune it where it would not prune another.
+  INL OfferID por_key(EdgeID e) const { return state.S.csr.offer[e]; }
+
+  // ctx is polled every poll_mask+1 nodes, since Ctx::done() is too expensive per node.
+  static constexpr size_t poll_mask = (1<<12)-1;
+  Ctx::Ptr ctx;
+  size_t nodes = 0;
+  bool stop = false;
+  void poll() {
+    if(!result->stopped.load(std::memory_order_relaxed) && !ctx->done()) return;
+    stop = true;
+    result->stopped = true;
+  }
+
+  bool should_split() const {
+    return state.depth<WorkPool::split_depth
+      && pool->idle.load(std::memory_order_relaxed)>0
+      && pool->queued.load(std::memory_order_relaxed)<pool->workers.size();
+  }
+
+  void spawn() { pool->push(worker_id,path); }
+
+  void work() {
+    Path task;
+    path.reserve(depth_limit);
+    bool is_idle = false;
+    while(1) {
+      if(pool->pop(worker_id,task)) {
+        if(is_idle){ pool->idle--; is_idle = false; }
+        path.clear();
+        on_pv = task.empty();
+        replay(task,0);
+        pool->pending--;
+        continue;
+      }
+      if(!pool->pending.load()) break;
+      if(!is_idle){ pool->idle++; is_idle = true; }
+      std::this_thread::yield();
+    }
+    if(is_idle) pool->idle--;
+    result->nodes += nodes;
+  }
+
+  // Applies the transactions of line[i:] which apply, see warm_start().
+  void seed(const Path &line, size_t i) {
+    if(state.wtb_used_count>best()) result->improve(state,path);
+    if(i==line.size()) return;
+    typename State::Transaction T(state,line[i]);
+    if(!T){ seed(line,i+1); return; }
+    path.push_back(line[i]);
+    pv.push_back(line[i]);
+    seed(line,i+1);
+    path.pop_back();
+  }
+
+  void replay(const Path &task, size_t i) {
+    if(i==task.size()){ run(); return; }
+    typename State::Transaction T(state,task[i]);
+    if(!T) error("replay(): transaction % not applicable",state.S.csr.show_edge(task[i]));
+    path.push_back(task[i]);
+    replay(task,i+1);
+    path.pop_back();
+  }
+};
+
+#endif  // SOLVER_H_
@@ -121,6 +121,20 @@ static vec<Offer> WTB() {
   };
 }
 
+// Indices of the WTB() offers which have been filled already.
+static vec<size_t> Filled() {
+  return {0,1,2,5,6,7,10,11,15,17,20,21,22,23,25,26,27,30,31,32};
+}
+
+static vec<Obj> Inventory() {
+  return {
+    {"g", 125},
+    {"Stormwind Cheddar", 1},
+    {"Iron Dagger", 2},
+    {"Golden Goblet", 1},
+  };
+}
+
 } // namespace spec
 
 #endif  // SPEC_H_
@@ -0,0 +1,92 @@
+#ifndef UTILS_BITSET_H_
+#define UTILS_BITSET_H_
+
+#include <cstdint>
+#include "utils/types.h"
+#include "utils/string.h"
+#include "utils/log.h"
+
+namespace util {
+
+// Fixed-size bitset of W 64-bit words.
+// Bitset<1> compiles down to plain uint64_t operations; for bigger W
+// all the operations are straight loops over an aligned array, which
+// the compiler unrolls and vectorizes.
+template<size_t W> struct Bitset {
+  static_assert(W>0);
+  static constexpr size_t words = W;
+  static constexpr size_t bits = 64*W;
+
+  alignas(W>1 ? 32 : 8) uint64_t w[W] = {};
+
+  INL Bitset(){}
+  INL Bitset(uint64_t x){ w[0] = x; }
+
+  // Bitset of bits [i,bits).
+  INL static Bitset from(size_t i) {
+    Bitset b;
+    for(size_t k=0; k<W; k++) {
+      size_t lo = 64*k;
+      b.w[k] = i<=lo ? ~0ull : i>=lo+64 ? 0 : ~0ull<<(i-lo);
+    }
+    return b;
+  }
+
+  INL bool test(size_t i) const { return (w[i>>6]>>(i&63))&1; }
+  INL void set(size_t i){ w[i>>6] |= 1ull<<(i&63); }
+  INL void reset(size_t i){ w[i>>6] &= ~(1ull<<(i&63)); }
+
+  INL size_t count() const {
+    size_t c = 0;
+    for(size_t k=0; k<W; k++) c += __builtin_popcountll(w[k]);
+    return c;
+  }
+  INL bool any() const {
+    uint64_t x = 0;
+    for(size_t k=0; k<W; k++) x |= w[k];
+    return x;
+  }
+
+  INL Bitset operator~() const { Bitset r; for(size_t k=0; k<W; k++) r.w[k] = ~w[k]; return r; }
+  INL Bitset operator&(const Bitset &b) const { Bitset r; for(size_t k=0; k<W; k++) r.w[k] = w[k]&b.w[k]; return r; }
+  INL Bitset operator|(const Bitset &b) const { Bitset r; for(size_t k=0; k<W; k++) r.w[k] = w[k]|b.w[k]; return r; }
+  INL Bitset& operator&=(const Bitset &b){ for(size_t k=0; k<W; k++) w[k] &= b.w[k]; return *this; }
+  INL Bitset& operator|=(const Bitset &b){ for(size_t k=0; k<W; k++) w[k] |= b.w[k]; return *this; }
+  INL bool operator==(const Bitset &b) const {
+    uint64_t x = 0;
+    for(size_t k=0; k<W; k++) x |= w[k]^b.w[k];
+    return !x;
+  }
+  INL bool operator!=(const Bitset &b) const { return !(*this==b); }
+
+  // Hexadecimal, most significant word first.
+  friend str show(const Bitset &b) {
+    str s;
+    for(size_t k=W; k--;) {
+      char buf[17];
+      snprintf(buf,sizeof buf,k==W-1 ? "%lx" : "%016lx",(unsigned long)b.w[k]);
+      s += buf;
+    }
+    return s;
+  }
+};
+
+// The widest Bitset of with_bitset(). It caps the WTB offers of the books
+// which the search supports.
+constexpr size_t max_bits = 1024;
+
+// Calls f(Bitset<W>()) for the smallest supported W which fits n bits,
+// up to max_bits.
+template<typename F> inline auto with_bitset(size_t n, F f) {
+  if(n<=64) return f(Bitset<1>());
+  if(n<=128) return f(Bitset<2>());
+  if(n<=256) return f(Bitset<4>());
+  if(n<=512) return f(Bitset<8>());
+  static_assert(max_bits==64*16);
+  if(n<=max_bits) return f(Bitset<16>());
+  error("with_bitset(): % bits not supported, at most %",n,max_bits);
+}
+
+}  // namespace util
+
+#endif  // UTILS_BITSET_H_
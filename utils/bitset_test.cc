@@ -0,0 +1,55 @@
+#include "gtest/gtest.h"
+#include "utils/types.h"
+#include "utils/bitset.h"
+
+using namespace util;
+
+TEST(bitset,set_test_reset) {
+  Bitset<2> b;
+  EXPECT_FALSE(b.any());
+  for(size_t i : {0,63,64,127}) b.set(i);
+  for(size_t i=0; i<128; i++) EXPECT_EQ(i==0 || i==63 || i==64 || i==127,b.test(i)) << i;
+  EXPECT_EQ(4,b.count());
+  b.reset(63);
+  EXPECT_FALSE(b.test(63));
+  EXPECT_EQ(3,b.count());
+}
+
+TEST(bitset,from) {
+  // Bits [i,bits).
+  for(size_t i : {0,1,63,64,65,127}) {
+    auto b = Bitset<2>::from(i);
+    EXPECT_EQ(128-i,b.count()) << i;
+    EXPECT_TRUE(b.test(127));
+    if(i){ EXPECT_FALSE(b.test(i-1)); }
+  }
+}
+
+TEST(bitset,ops) {
+  Bitset<2> a, b;
+  a.set(1); a.set(100);
+  b.set(100); b.set(2);
+  EXPECT_EQ(1,(a&b).count());
+  EXPECT_EQ(3,(a|b).count());
+  EXPECT_EQ(126,(~a).count());
+  EXPECT_NE(a,b);
+  b.reset(2); b.set(1);
+  EXPECT_EQ(a,b);
+  a |= Bitset<2>(8);
+  EXPECT_TRUE(a.test(3));
+  a &= Bitset<2>(8);
+  EXPECT_EQ(Bitset<2>(8),a);
+}
+
+TEST(bitset,show) {
+  Bitset<2> b(0xab);
+  b.set(64);
+  EXPECT_EQ("100000000000000ab",show(b));
+}
+
+TEST(with_bitset,width) {
+  EXPECT_EQ(1,with_bitset(0,[](auto b){ return decltype(b)::words; }));
+  EXPECT_EQ(1,with_bitset(64,[](auto b){ return decltype(b)::words; }));
+  EXPECT_EQ(2,with_bitset(65,[](auto b){ return decltype(b)::words; }));
+  EXPECT_EQ(16,with_bitset(max_bits,[](auto b){ return decltype(b)::words; }));
+}
@@ -0,0 +1,65 @@
+#ifndef UTILS_FIXED_VEC_H_
+#define UTILS_FIXED_VEC_H_
+
+#include <algorithm>
+#include <type_traits>
+#include "utils/types.h"
+#include "utils/log.h"
+
+namespace util {
+
+// Vector of at most N elements, stored inline, so that it needs no allocation
+// and lives in the cache lines of its owner. The storage is 64-byte aligned,
+// the unused elements are kept zero and copy and comparison are straight loops
+// over all the N elements, which the compiler vectorizes.
+template<typename T, size_t N> struct FixedVec {
+  static constexpr size_t capacity = N;
+
+  alignas(64) T a[N] = {};
+  size_t n = 0;
+
+  FixedVec(){}
+  FixedVec(const vec<T> &v){ *this = v; }
+  FixedVec& operator=(const vec<T> &v) {
+    if(v.size()>N) error("FixedVec: % elements, capacity %",v.size(),N);
+    n = v.size();
+    std::copy(v.begin(),v.end(),a);
+    std::fill(a+n,a+N,T());
+    return *this;
+  }
+  operator vec<T>() const { return vec<T>(a,a+n); }
+
+  INL size_t size() const { return n; }
+  INL T& operator[](size_t i){ return a[i]; }
+  INL const T& operator[](size_t i) const { return a[i]; }
+  INL T* begin(){ return a; }
+  INL T* end(){ return a+n; }
+  INL const T* begin() const { return a; }
+  INL const T* end() const { return a+n; }
+
+  INL bool operator==(const FixedVec &b) const {
+    T x = 0;
+    for(size_t i=0; i<N; i++) x |= a[i]^b.a[i];
+    return !x && n==b.n;
+  }
+  INL bool operator!=(const FixedVec &b) const { return !(*this==b); }
+};
+
+// The biggest capacity of with_capacity().
+constexpr size_t max_capacity = 1024;
+
+// Calls f(std::integral_constant<size_t,N>()) for the smallest supported
+// capacity N which fits n elements, up to max_capacity. The capacities grow
+// 4 times, which keeps the number of instantiations of the callers low.
+template<typename F> inline auto with_capacity(size_t n, F f) {
+  if(n<=16) return f(std::integral_constant<size_t,16>());
+  if(n<=64) return f(std::integral_constant<size_t,64>());
+  if(n<=256) return f(std::integral_constant<size_t,256>());
+  static_assert(max_capacity==1024);
+  if(n<=max_capacity) return f(std::integral_constant<size_t,1024>());
+  error("with_capacity(): % elements not supported, at most %",n,max_capacity);
+}
+
+}  // namespace util
+
+#endif  // UTILS_FIXED_VEC_H_
@@ -0,0 +1,42 @@
+#include "gtest/gtest.h"
+#include "utils/types.h"
+#include "utils/fixed_vec.h"
+
+using namespace util;
+
+TEST(fixed_vec,assign) {
+  FixedVec<uint64_t,8> v(vec<uint64_t>{3,1,4});
+  ASSERT_EQ(3,v.size());
+  EXPECT_EQ(4,v[2]);
+  v[1] = 5;
+  EXPECT_EQ((vec<uint64_t>{3,5,4}),vec<uint64_t>(v));
+  // The unused elements are cleared by a shorter assignment.
+  v = vec<uint64_t>{7};
+  EXPECT_EQ(1,v.size());
+  for(size_t i=1; i<v.capacity; i++) EXPECT_EQ(0,v.a[i]);
+}
+
+TEST(fixed_vec,compare) {
+  FixedVec<uint64_t,4> a(vec<uint64_t>{1,2}), b(vec<uint64_t>{1,2});
+  EXPECT_EQ(a,b);
+  b[1] = 3;
+  EXPECT_NE(a,b);
+  // The same elements, but a different size.
+  FixedVec<uint64_t,4> c(vec<uint64_t>{1,2,0});
+  EXPECT_NE(a,c);
+}
+
+TEST(fixed_vec,iterate) {
+  FixedVec<uint32_t,4> v(vec<uint32_t>{1,2,3});
+  uint32_t s = 0;
+  for(auto x : v) s += x;
+  EXPECT_EQ(6,s);
+}
+
+TEST(with_capacity,capacity) {
+  EXPECT_EQ(16,with_capacity(0,[](auto n){ return decltype(n)::value; }));
+  EXPECT_EQ(16,with_capacity(16,[](auto n){ return decltype(n)::value; }));
+  EXPECT_EQ(64,with_capacity(17,[](auto n){ return decltype(n)::value; }));
+  EXPECT_EQ(256,with_capacity(200,[](auto n){ return decltype(n)::value; }));
+  EXPECT_EQ(max_capacity,with_capacity(max_capacity,[](auto n){ return decltype(n)::value; }));
+}
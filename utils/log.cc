@@ -1,3 +1,3 @@
 #include "utils/log.h"
 
-Profile profile;
+thread_local Profile profile;
@@ -15,6 +15,7 @@
 #include <errno.h>
 #include <x86intrin.h>
 #include <map>
+#include <mutex>
 
 #define INL [[gnu::always_inline]]
 #define INLL __attribute__((always_inline))
@@ -193,23 +194,59 @@ struct Profile {
   };
 
   std::map<str,Scope> scopes;
+  std::map<str,vec<size_t>> histograms; // histograms[name][i] = count of i
+
   str show() {
     vec<str> lines;
-    for(auto &[name,s] : scopes) lines.push_back(util::fmt("% : count = %, cycles = %, time = %\n",name,s.count,s.cycles,s.time));
+    for(auto &[name,s] : scopes) lines.push_back(util::fmt("% : count = %, cycles = %, cycles/count = %, time = %\n",name,s.count,s.cycles,s.count ? s.cycles/s.count : 0,s.time));
+    for(auto &[name,h] : histograms) {
+      lines.push_back(util::fmt("% :\n",name));
+      for(size_t i=0; i<h.size(); i++) if(h[i]) lines.push_back(util::fmt("  % : %\n",i,h[i]));
+    }
     return util::join("",lines);
   }
+
+  void merge(const Profile &p) {
+    for(auto &[name,s] : p.scopes) {
+      auto &t = scopes[name];
+      t.count += s.count;
+      t.cycles += s.cycles;
+      t.time += s.time;
+    }
+    for(auto &[name,h] : p.histograms) {
+      auto &t = histograms[name];
+      if(t.size()<h.size()) t.resize(h.size());
+      for(size_t i=0; i<h.size(); i++) t[i] += h[i];
+    }
+  }
+
+  // Profiles of the threads, merged by flush().
+  static Profile& total(){ static Profile p; return p; }
+
+  // Moves the counters of this thread to total().
+  void flush() {
+    static std::mutex mtx;
+    std::lock_guard<std::mutex> L(mtx);
+    total().merge(*this);
+    for(auto &[name,s] : scopes) s = Scope();
+    for(auto &[name,h] : histograms) std::fill(h.begin(),h.end(),0);
+  }
+  ~Profile(){ if(this!=&total()) flush(); }
 };
 
-extern Profile profile;
+// Every thread has its own profile, flushed to Profile::total() at the thread exit.
+extern thread_local Profile profile;
 
 #ifdef PROFILE
-  #define PROF_COUNT(name)  static auto &_scope = profile.scopes[name]; Profile::MeasureCount _visit(_scope);
-  #define PROF_CYCLES(name) static auto &_scope = profile.scopes[name]; Profile::MeasureCyclesSimple _visit(_scope);
-  #define PROF_TIME(name)   static auto &_scope = profile.scopes[name]; Profile::MeasureTime _visit(_scope);
+  #define PROF_COUNT(name)  static thread_local auto &_scope = profile.scopes[name]; Profile::MeasureCount _visit(_scope);
+  #define PROF_CYCLES(name) static thread_local auto &_scope = profile.scopes[name]; Profile::MeasureCyclesSimple _visit(_scope);
+  #define PROF_TIME(name)   static thread_local auto &_scope = profile.scopes[name]; Profile::MeasureTime _visit(_scope);
+  #define PROF_HIST(name,i) { static thread_local auto &_hist = profile.histograms[name]; if(_hist.size()<=size_t(i)) _hist.resize(size_t(i)+1); _hist[i]++; }
 #else
   #define PROF_COUNT(name)
   #define PROF_CYCLES(name)
   #define PROF_TIME(name)
+  #define PROF_HIST(name,i)
 #endif
 
 #ifdef VERBOSE
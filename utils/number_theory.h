@@ -1,6 +1,8 @@
 #ifndef UTILS_NUMBER_THEORY_H_
 #define UTILS_NUMBER_THEORY_H_
 
+#include <limits>
+
 namespace util {
 
 template<typename T> constexpr T pow(T a, T b) {
@@ -27,6 +29,14 @@ template<typename T> constexpr T inv(T a) {
   return pow<T>(a,tot-T(1));
 }
 
+// a*b, saturated at the maximal value of T instead of overflowing.
+// T is an unsigned integer type.
+template<typename T> constexpr T mul_sat(T a, T b) {
+  static_assert(T(-1)>T(0));
+  T r = 0;
+  return __builtin_mul_overflow(a,b,&r) ? std::numeric_limits<T>::max() : r;
+}
+
 }  // namespace utils
 
 #endif  // UTILS_NUMBER_THEORY_H_
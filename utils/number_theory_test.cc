@@ -12,3 +12,10 @@ TEST(inv,simple) {
     EXPECT_EQ(1,uint64_t(x*inv<uint64_t>(x)));
   }
 }
+
+TEST(mul_sat,simple) {
+  EXPECT_EQ(6,mul_sat<uint64_t>(2,3));
+  EXPECT_EQ(uint64_t(-1),mul_sat<uint64_t>(1ull<<32,1ull<<32));
+  EXPECT_EQ(uint8_t(255),mul_sat<uint8_t>(16,16));
+  EXPECT_EQ(uint8_t(225),mul_sat<uint8_t>(15,15));
+}
@@ -0,0 +1,26 @@
+#ifndef UTILS_PARALLEL_H_
+#define UTILS_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "utils/types.h"
+
+namespace util {
+
+// Calls f(worker,i) for i in [0,n), on min(threads,n) threads, the caller being
+// the worker 0. The tasks are handed out one by one, so that uneven ones balance.
+// The calls with the same worker do not overlap.
+template<typename F> inline void parallel_for(size_t n, size_t threads, F f) {
+  std::atomic<size_t> next{0};
+  auto work = [&](size_t worker){ for(size_t i; (i = next++)<n;) f(worker,i); };
+  threads = std::max<size_t>(1,std::min(threads,n));
+  vec<std::thread> T;
+  for(size_t w=1; w<threads; w++) T.emplace_back(work,w);
+  work(0);
+  for(auto &t : T) t.join();
+}
+
+}  // namespace util
+
+#endif  // UTILS_PARALLEL_H_
@@ -8,6 +8,9 @@
 #include <cstring>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "utils/types.h"
 #include "utils/string.h"
 #include "utils/log.h"
@@ -44,6 +47,32 @@ inline void write_file(str path, const Bytes &data) {
   if(fclose(f)) error("fclose(): %",strerror(errno));
 }
 
+// Read-only memory mapping of a whole file.
+struct MappedFile {
+  explicit MappedFile(str path) {
+    int fd = open(path.c_str(),O_RDONLY); if(fd==-1) error("open('%') = %",path,strerror(errno));
+    struct stat st;
+    if(fstat(fd,&st)) error("fstat('%') = %",path,strerror(errno));
+    size_ = st.st_size;
+    // mmap() of 0 bytes fails with EINVAL.
+    if(size_) {
+      void *m = mmap(0,size_,PROT_READ,MAP_PRIVATE,fd,0);
+      if(m==MAP_FAILED) error("mmap('%') = %",path,strerror(errno));
+      data_ = (const Byte*)m;
+    }
+    if(close(fd)) error("close(): %",strerror(errno));
+  }
+  ~MappedFile(){ if(size_) munmap((void*)data_,size_); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const Byte* data() const { return data_; }
+  size_t size() const { return size_; }
+private:
+  const Byte *data_ = 0;
+  size_t size_ = 0;
+};
+
 }  // namespace util
 
 #endif  // READ_FILE_H_
@@ -0,0 +1,85 @@
+#ifndef UTILS_SIMPLEX_H_
+#define UTILS_SIMPLEX_H_
+
+#include <cmath>
+#include "utils/types.h"
+
+namespace util {
+
+// Dense tableau simplex for
+//   max c^T x  s.t.  A x <= b, x >= 0,
+// where b >= 0, so that x = 0 is a feasible starting basis.
+// Pivots by the steepest reduced cost (Dantzig), falling back to Bland's rule
+// (which cannot cycle) after too many iterations.
+struct Simplex {
+  enum Status { OPTIMAL, UNBOUNDED };
+
+  // A is m x n, in row-major order.
+  Simplex(size_t _m, size_t _n, const vec<double> &A, const vec<double> &b, const vec<double> &c)
+      : m(_m), n(_n), w(n+m+1), T((m+1)*w,0.), basis(m) {
+    for(size_t i=0; i<m; i++) {
+      for(size_t j=0; j<n; j++) at(i,j) = A[i*n+j];
+      at(i,n+i) = 1;
+      at(i,n+m) = b[i];
+      basis[i] = n+i;
+    }
+    for(size_t j=0; j<n; j++) at(m,j) = -c[j];
+  }
+
+  Status solve() {
+    size_t dantzig_iters = 50*(m+n);
+    for(size_t it=0;; it++) {
+      bool bland = it>=dantzig_iters;
+      // Entering column.
+      size_t jin = w;
+      for(size_t j=0; j<n+m; j++) {
+        if(at(m,j)>=-eps) continue;
+        if(jin==w || (!bland && at(m,j)<at(m,jin))) jin = j;
+        if(bland) break;
+      }
+      if(jin==w) break;
+      // Leaving row, by the ratio test.
+      size_t iout = m;
+      for(size_t i=0; i<m; i++) {
+        if(at(i,jin)<=eps) continue;
+        if(iout==m) { iout = i; continue; }
+        double d = at(i,n+m)*at(iout,jin)-at(iout,n+m)*at(i,jin);
+        if(d<-eps || (d<=eps && basis[i]<basis[iout])) iout = i;
+      }
+      if(iout==m) return UNBOUNDED;
+      pivot(iout,jin);
+    }
+    value = at(m,n+m);
+    x.assign(n,0);
+    for(size_t i=0; i<m; i++) if(basis[i]<n) x[basis[i]] = at(i,n+m);
+    return OPTIMAL;
+  }
+
+  double value = 0;
+  vec<double> x;
+
+private:
+  static constexpr double eps = 1e-9;
+  size_t m,n,w;
+  vec<double> T;
+  vec<size_t> basis;
+
+  double& at(size_t i, size_t j){ return T[i*w+j]; }
+
+  void pivot(size_t r, size_t c) {
+    double p = at(r,c);
+    for(size_t j=0; j<w; j++) at(r,j) /= p;
+    for(size_t i=0; i<=m; i++) {
+      if(i==r) continue;
+      double f = at(i,c);
+      if(std::abs(f)<=eps) continue;
+      double *dst = &T[i*w], *src = &T[r*w];
+      for(size_t j=0; j<w; j++) dst[j] -= f*src[j];
+    }
+    basis[r] = c;
+  }
+};
+
+}  // namespace util
+
+#endif  // UTILS_SIMPLEX_H_
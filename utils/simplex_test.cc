@@ -0,0 +1,27 @@
+#include "gtest/gtest.h"
+#include "utils/types.h"
+#include "utils/simplex.h"
+
+using namespace util;
+
+TEST(simplex,optimal) {
+  // max 3x+5y  s.t.  x<=4, 2y<=12, 3x+2y<=18
+  Simplex S(3,2,{1,0, 0,2, 3,2},{4,12,18},{3,5});
+  ASSERT_EQ(Simplex::OPTIMAL,S.solve());
+  EXPECT_NEAR(36,S.value,1e-9);
+  EXPECT_NEAR(2,S.x[0],1e-9);
+  EXPECT_NEAR(6,S.x[1],1e-9);
+}
+
+TEST(simplex,unbounded) {
+  // max x+y  s.t.  x-y<=1
+  Simplex S(1,2,{1,-1},{1},{1,1});
+  EXPECT_EQ(Simplex::UNBOUNDED,S.solve());
+}
+
+TEST(simplex,degenerate) {
+  // max x+y  s.t.  x+y<=0, x<=1
+  Simplex S(2,2,{1,1, 1,0},{0,1},{1,1});
+  ASSERT_EQ(Simplex::OPTIMAL,S.solve());
+  EXPECT_NEAR(0,S.value,1e-9);
+}